@@ -0,0 +1,297 @@
+/* -*- mode: c++ -*- */
+#ifndef CSVDIFF_HPP
+#define CSVDIFF_HPP
+/* csvdiff.hpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ *
+ * Compare two snapshots of a CSV file with a unique key.  The old snapshot is
+ * reduced to a table of keys and row hashes, which doesn't depend on the size
+ * of the other values.  The new snapshot is streamed against the table to
+ * find added and changed rows, then the old snapshot is read again to find
+ * removed rows.
+ */
+
+#include "csvstream.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+
+
+// csvdiff interface
+class csvdiff {
+public:
+  enum change_type {ADDED, REMOVED, CHANGED};
+
+  // One changed row.  row is the new row, or the old row if it was removed.
+  struct change {
+    change_type type;
+    std::vector<std::string> key;
+    std::vector<std::string> row;
+  };
+
+  // Load the old snapshot's keys.  Both files must have the same header.
+  // Throws csvstream_exception if a file can't be read, a key column doesn't
+  // exist, the headers differ, or a key appears twice.
+  csvdiff(const std::string &old_filename,
+          const std::string &new_filename,
+          const std::vector<std::string> &key_columns,
+          char delimiter=',')
+    : old_filename(old_filename),
+      new_filename(new_filename),
+      delimiter(delimiter),
+      old_in(new csvstream(old_filename, delimiter)),
+      new_in(new csvstream(new_filename, delimiter)),
+      nrows(0),
+      nentries(0),
+      hash(0),
+      new_line_no(0),
+      reading_old(false),
+      done(false) {
+    header = old_in->getheader();
+    if (new_in->getheader() != header) {
+      throw csvstream_exception("Header does not match " + old_filename +
+                                ". " + new_filename);
+    }
+    for (auto &name : key_columns) {
+      size_t i = 0;
+      while (i < header.size() && header[i] != name) ++i;
+      if (i == header.size()) {
+        throw csvstream_exception("No such column: " + name);
+      }
+      key_cols.push_back(i);
+    }
+    load();
+  }
+
+  // Return false after the last change has been read
+  explicit operator bool() const {
+    return !done;
+  }
+
+  // Return header of both files
+  const std::vector<std::string> & getheader() const {
+    return header;
+  }
+
+  // Return number of rows in the old snapshot
+  size_t old_size() const {
+    return nrows;
+  }
+
+  // Return approximate bytes of memory used by the table of keys
+  size_t memory_usage() const {
+    return slots.capacity() * sizeof(entry) + seen.capacity() / 8 +
+      keys.capacity();
+  }
+
+  // Stream extraction operator reads the next change.  Added and changed
+  // rows come first, in the new snapshot's order, then removed rows in the
+  // old snapshot's order.  Throws csvstream_exception if a key appears twice
+  // in the new snapshot.
+  csvdiff & operator>> (change &c) {
+    if (!done && !next(c)) done = true;
+    return *this;
+  }
+
+private:
+  // One key.  Its encoded values are keys[key_begin .. key_end), and
+  // row_hash is the hash of the old row with that key.  A key hash of 0 marks
+  // an empty slot.
+  struct entry {
+    uint64_t key_hash;
+    uint64_t row_hash;
+    uint64_t key_begin;
+    uint64_t key_end;
+  };
+
+  // Filenames.  Used for error messages.
+  std::string old_filename;
+  std::string new_filename;
+
+  // Delimiter of both files
+  char delimiter;
+
+  // Inputs
+  std::unique_ptr<csvstream> old_in;
+  std::unique_ptr<csvstream> new_in;
+
+  // Position of the first row of the old snapshot, for reading it again
+  csvcheckpoint old_start;
+
+  // Header of both files
+  std::vector<std::string> header;
+
+  // Indices of the key columns
+  std::vector<size_t> key_cols;
+
+  // Open addressing hash table of rows by key, and whether each key was
+  // found in the new snapshot.  Keys only in the new snapshot are added as
+  // they're found, to detect duplicates.
+  std::vector<entry> slots;
+  std::vector<bool> seen;
+
+  // Encoded values of every key in the table, concatenated
+  std::string keys;
+
+  // Number of old rows
+  size_t nrows;
+
+  // Number of keys in the table
+  size_t nentries;
+
+  // Encoded values of the current row's key, and its hash
+  std::string key;
+  uint64_t hash;
+
+  // Line number in the new snapshot.  Used for error messages.
+  size_t new_line_no;
+
+  // True after the new snapshot has been read
+  bool reading_old;
+
+  // True after the last change has been read
+  bool done;
+
+  // Reused buffer for reading one row
+  csvrow row;
+
+  // Disable copying
+  csvdiff(const csvdiff &);
+  csvdiff & operator= (const csvdiff &);
+
+  // Encode the key columns of the current row into key, each value preceded
+  // by its size, so "a,bc" and "ab,c" are different keys.  Set hash to its
+  // hash, never 0.
+  void read_key() {
+    key.clear();
+    for (size_t c : key_cols) {
+      const std::string &value = row[c];
+      uint64_t size = value.size();
+      key.append(reinterpret_cast<const char *>(&size), sizeof(size));
+      key += value;
+    }
+    hash = csvstream_hash(key.data(), key.size());
+    if (!hash) hash = 1;
+  }
+
+  // Return true if slot i holds the current key
+  bool key_equal(size_t i) const {
+    const entry &e = slots[i];
+    return e.key_hash == hash && e.key_end - e.key_begin == key.size() &&
+      std::memcmp(keys.data() + e.key_begin, key.data(), key.size()) == 0;
+  }
+
+  // Return the slot for the current key, which is empty or holds the key.
+  // Keys with the same hash are told apart by their values.
+  size_t find_slot() const {
+    size_t mask = slots.size() - 1;
+    size_t i = static_cast<size_t>(hash) & mask;
+    while (slots[i].key_hash && !key_equal(i)) i = (i + 1) & mask;
+    return i;
+  }
+
+  // Add the current key to the table, growing it to keep it at most 3/4
+  // full, and return its slot
+  size_t insert() {
+    if (4 * (nentries + 1) > 3 * slots.size()) {
+      entry empty = {0, 0, 0, 0};
+      std::vector<entry> old_slots(2 * slots.size(), empty);
+      std::vector<bool> old_seen(2 * slots.size(), false);
+      old_slots.swap(slots);
+      old_seen.swap(seen);
+      // Keys in the table are distinct, so only their hashes are compared
+      size_t mask = slots.size() - 1;
+      for (size_t i=0; i<old_slots.size(); ++i) {
+        if (!old_slots[i].key_hash) continue;
+        size_t j = static_cast<size_t>(old_slots[i].key_hash) & mask;
+        while (slots[j].key_hash) j = (j + 1) & mask;
+        slots[j] = old_slots[i];
+        seen[j] = old_seen[i];
+      }
+    }
+    size_t i = find_slot();
+    slots[i].key_hash = hash;
+    slots[i].key_begin = keys.size();
+    keys += key;
+    slots[i].key_end = keys.size();
+    nentries += 1;
+    return i;
+  }
+
+  // Load the keys of the old snapshot
+  void load() {
+    old_start = old_in->checkpoint();
+    entry empty = {0, 0, 0, 0};
+    slots.assign(16, empty);
+    seen.assign(16, false);
+    while (*old_in >> row) {
+      nrows += 1;
+      read_key();
+      if (slots[find_slot()].key_hash) duplicate_key(old_filename, nrows);
+      slots[insert()].row_hash = row.hash();
+    }
+  }
+
+  // Return the values of the key columns of the current row
+  std::vector<std::string> key_values() const {
+    std::vector<std::string> values(key_cols.size());
+    for (size_t i=0; i<key_cols.size(); ++i) values[i] = row[key_cols[i]];
+    return values;
+  }
+
+  // Throw an exception for a key that appears twice, at line_no of filename
+  [[noreturn]] static void duplicate_key(const std::string &filename,
+                                         size_t line_no) {
+    throw csvstream_exception("Duplicate key. " + filename + ":L" +
+                              std::to_string(line_no) + " ");
+  }
+
+  // Fill in a change from the current row
+  void set(change &c, change_type type) const {
+    c.type = type;
+    c.key = key_values();
+    c.row.resize(row.size());
+    for (size_t i=0; i<row.size(); ++i) c.row[i] = row[i];
+  }
+
+  // Find the next change.  Return false if there are no more.
+  bool next(change &c) {
+    while (!reading_old && *new_in >> row) {
+      new_line_no += 1;
+      read_key();
+      size_t i = find_slot();
+      if (!slots[i].key_hash) {
+        seen[insert()] = true;
+        set(c, ADDED);
+        return true;
+      }
+      if (seen[i]) duplicate_key(new_filename, new_line_no);
+      seen[i] = true;
+      if (slots[i].row_hash != row.hash()) {
+        set(c, CHANGED);
+        return true;
+      }
+    }
+
+    if (!reading_old) {
+      reading_old = true;
+      old_in->resume(old_start);
+    }
+    while (*old_in >> row) {
+      read_key();
+      if (!seen[find_slot()]) {
+        set(c, REMOVED);
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+#endif
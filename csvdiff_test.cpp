@@ -0,0 +1,229 @@
+/* csvdiff_test.cpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ */
+
+#include "csvdiff.hpp"
+#include "csvtest.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+using namespace std;
+
+
+void test_diff();
+void test_diff_unchanged();
+void test_diff_many_added();
+void test_diff_compound_key();
+void test_diff_row_hash();
+void test_diff_key_hash_collision();
+void test_diff_duplicate_key();
+void test_diff_header_mismatch();
+
+
+const string old_filename = "csvdiff_test_old.csv";
+const string new_filename = "csvdiff_test_new.csv";
+
+
+int main() {
+  test_diff();
+  test_diff_unchanged();
+  test_diff_many_added();
+  test_diff_compound_key();
+  test_diff_row_hash();
+  test_diff_key_hash_collision();
+  test_diff_duplicate_key();
+  test_diff_header_mismatch();
+  remove(old_filename.c_str());
+  remove(new_filename.c_str());
+  cout << "csvdiff_test PASSED\n";
+  return 0;
+}
+
+
+// Read every change into a string, one line per change
+string read_changes(csvdiff &diff) {
+  const char *names[] = {"added", "removed", "changed"};
+  string output;
+  csvdiff::change c;
+  while (diff >> c) {
+    output += names[c.type];
+    for (auto &k : c.key) output += " " + k;
+    output += ":";
+    for (auto &v : c.row) output += " " + v;
+    output += "\n";
+  }
+  return output;
+}
+
+
+void test_diff() {
+  // Test finding added, removed and changed rows
+  write_file(old_filename,
+             "id,name,animal\n"
+             "1,Fergie,horse\n"
+             "2,Myrtle II,chicken\n"
+             "3,Oscar,cat\n"
+             "4,\"Bella, the dog\",dog\n");
+  write_file(new_filename,
+             "id,name,animal\n"
+             "5,Rex,dinosaur\n"
+             "4,\"Bella, the dog\",dog\n"
+             "2,Myrtle III,chicken\n"
+             "1,Fergie,horse\n");
+  csvdiff diff(old_filename, new_filename, {"id"});
+  assert(diff.getheader() == vector<string>({"id", "name", "animal"}));
+  assert(diff.old_size() == 4);
+  string output_observed = read_changes(diff);
+  assert(output_observed ==
+         "added 5: 5 Rex dinosaur\n"
+         "changed 2: 2 Myrtle III chicken\n"
+         "removed 3: 3 Oscar cat\n");
+  assert(!diff);
+}
+
+
+void test_diff_unchanged() {
+  // Test identical snapshots, and an empty new snapshot
+  write_file(old_filename, "id,name\n1,Fergie\n2,Oscar\n");
+  write_file(new_filename, "id,name\n2,Oscar\n1,Fergie\n");
+  csvdiff same(old_filename, new_filename, {"id"});
+  string output_observed = read_changes(same);
+  assert(output_observed == "");
+
+  write_file(new_filename, "id,name\n");
+  csvdiff empty(old_filename, new_filename, {"id"});
+  output_observed = read_changes(empty);
+  assert(output_observed == "removed 1: 1 Fergie\nremoved 2: 2 Oscar\n");
+}
+
+
+void test_diff_many_added() {
+  // Test adding enough keys that the table grows while the new snapshot is
+  // read
+  string old_contents = "id,name\n";
+  string new_contents = "id,name\n";
+  for (int i=0; i<100; ++i) {
+    old_contents += to_string(i) + ",x\n";
+    new_contents += to_string(i + 50) + ",x\n";
+  }
+  write_file(old_filename, old_contents);
+  write_file(new_filename, new_contents);
+  csvdiff diff(old_filename, new_filename, {"id"});
+  size_t counts[3] = {0, 0, 0};
+  csvdiff::change c;
+  while (diff >> c) counts[c.type] += 1;
+  assert(counts[csvdiff::ADDED] == 50);
+  assert(counts[csvdiff::REMOVED] == 50);
+  assert(counts[csvdiff::CHANGED] == 0);
+}
+
+
+void test_diff_compound_key() {
+  // Test a key of two columns.  Values are separated in the key, so "a,bc"
+  // and "ab,c" are different keys.
+  write_file(old_filename, "k1,k2,v\na,bc,1\nab,c,2\n");
+  write_file(new_filename, "k1,k2,v\nab,c,2\na,bc,3\n");
+  csvdiff diff(old_filename, new_filename, {"k1", "k2"});
+  string output_observed = read_changes(diff);
+  assert(output_observed == "changed a bc: a bc 3\n");
+}
+
+
+void test_diff_row_hash() {
+  // Test that moving text between values changes a row
+  write_file(old_filename, "id,a,b\n1,xy,z\n");
+  write_file(new_filename, "id,a,b\n1,x,yz\n");
+  csvdiff diff(old_filename, new_filename, {"id"});
+  string output_observed = read_changes(diff);
+  assert(output_observed == "changed 1: 1 x yz\n");
+}
+
+
+void test_diff_key_hash_collision() {
+  // Test two different keys with the same 64-bit hash, when each value is
+  // preceded by its size in little endian byte order.  They're paired by
+  // their values, not their hash.
+  const string a = "ddfa9b2622e86aa4";
+  const string b = "13902832dad4e5a3";
+  write_file(old_filename, "id,name\n" + a + ",Fergie\n");
+  write_file(new_filename, "id,name\n" + b + ",Fergie\n");
+  csvdiff diff(old_filename, new_filename, {"id"});
+  string output_observed = read_changes(diff);
+  assert(output_observed ==
+         "added " + b + ": " + b + " Fergie\n"
+         "removed " + a + ": " + a + " Fergie\n");
+
+  // Both keys in both snapshots
+  write_file(old_filename, "id,name\n" + a + ",Fergie\n" + b + ",Oscar\n");
+  write_file(new_filename, "id,name\n" + b + ",Oscar\n" + a + ",Myrtle\n");
+  csvdiff both(old_filename, new_filename, {"id"});
+  output_observed = read_changes(both);
+  assert(output_observed == "changed " + a + ": " + a + " Myrtle\n");
+}
+
+
+void test_diff_duplicate_key() {
+  // Test error condition: a key that appears twice
+  write_file(old_filename, "id,name\n1,Fergie\n1,Oscar\n");
+  write_file(new_filename, "id,name\n1,Fergie\n");
+  try {
+    csvdiff diff(old_filename, new_filename, {"id"});
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()) == "Duplicate key. " + old_filename + ":L2 ");
+  }
+
+  write_file(old_filename, "id,name\n1,Fergie\n");
+  write_file(new_filename, "id,name\n1,Fergie\n1,Oscar\n");
+  csvdiff diff(old_filename, new_filename, {"id"});
+  try {
+    read_changes(diff);
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()) == "Duplicate key. " + new_filename + ":L2 ");
+  }
+
+  // A key that's only in the new snapshot
+  write_file(old_filename, "id,name\n1,Fergie\n");
+  write_file(new_filename, "id,name\n1,Fergie\n2,Oscar\n3,Myrtle\n2,Bella\n");
+  csvdiff added(old_filename, new_filename, {"id"});
+  csvdiff::change c;
+  added >> c;
+  assert(added);
+  assert(c.type == csvdiff::ADDED && c.key == vector<string>({"2"}));
+  added >> c;
+  assert(added);
+  assert(c.key == vector<string>({"3"}));
+  try {
+    added >> c;
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()) == "Duplicate key. " + new_filename + ":L4 ");
+  }
+}
+
+
+void test_diff_header_mismatch() {
+  // Test error conditions: different headers, and a missing key column
+  write_file(old_filename, "id,name\n");
+  write_file(new_filename, "id,animal\n");
+  try {
+    csvdiff diff(old_filename, new_filename, {"id"});
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()).find("Header does not match") == 0);
+  }
+
+  write_file(new_filename, "id,name\n");
+  try {
+    csvdiff diff(old_filename, new_filename, {"key"});
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()) == "No such column: key");
+  }
+}
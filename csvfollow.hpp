@@ -0,0 +1,290 @@
+/* -*- mode: c++ -*- */
+#ifndef CSVFOLLOW_HPP
+#define CSVFOLLOW_HPP
+/* csvfollow.hpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ *
+ * Follow a CSV file that is being appended to, like "tail -F".  Rows are
+ * delivered as soon as their line ending is written.  A row that is only
+ * partly written is held back until it's complete.  When the file is rotated
+ * (renamed and replaced) or truncated, reading continues with the new file.
+ */
+
+#include "csvstream.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+
+// csvfollow interface
+class csvfollow {
+public:
+  typedef std::chrono::milliseconds duration;
+
+  // Open a file and read its header if it has been written.  On Linux, new
+  // data is noticed with inotify.  The file is also checked every
+  // poll_interval, which is how new data is noticed without inotify.  Throws
+  // csvstream_exception if open fails.
+  csvfollow(const std::string &filename,
+            char delimiter=',',
+            bool strict=true,
+            duration poll_interval=duration(250))
+    : filename(filename),
+      delimiter(delimiter),
+      strict(strict),
+      poll_interval(poll_interval),
+      notify_fd(-1),
+      nrotations(0),
+      buffer(64 * 1024) {
+    open();
+    watch();
+    update();
+  }
+
+  // Destructor
+  ~csvfollow() {
+    if (notify_fd >= 0) close(notify_fd);
+  }
+
+  // Return header, which is empty until the first line has been written
+  std::vector<std::string> getheader() const {
+    return header;
+  }
+
+  // Return number of times the file was rotated or truncated
+  size_t rotations() const {
+    return nrotations;
+  }
+
+  // Read one row, waiting up to timeout for it to be written.  Return false
+  // if no complete row was written in time, or the row couldn't be read.  Row is a map, vector of pairs or
+  // vector of values, as with csvstream.  Throws csvstream_exception if a row
+  // doesn't match the header, or a new file's header doesn't match the first.
+  template <typename Row>
+  bool read(Row &row, duration timeout) {
+    auto deadline = clock::now() + timeout;
+    while (true) {
+      if (!pending) update();
+      if (pending) {
+        pending -= 1;
+        line_no += 1;
+        return static_cast<bool>(*csvin >> row);
+      }
+      auto now = clock::now();
+      if (now >= deadline) return false;
+      wait(std::chrono::duration_cast<duration>(deadline - now) + duration(1));
+    }
+  }
+
+private:
+  typedef std::chrono::steady_clock clock;
+
+  // Tokenizer states, following csvstream's quoting, escaping and line
+  // ending rules
+  enum State {START, QUOTED, QUOTED_ESCAPED, UNQUOTED, UNQUOTED_ESCAPED, END};
+
+  // Filename
+  std::string filename;
+
+  // Delimiter between columns
+  char delimiter;
+
+  // Strictly enforce the number of values in each row
+  bool strict;
+
+  // Maximum time between checks of the file
+  duration poll_interval;
+
+  // inotify descriptor watching the file's directory, or -1
+  int notify_fd;
+
+  // Header of the first file
+  std::vector<std::string> header;
+
+  // Number of times the file was replaced
+  size_t nrotations;
+
+  // Identity of the open file
+  dev_t dev;
+  ino_t ino;
+
+  // Scanner for finding complete rows.  It reads ahead of csvin.
+  std::ifstream fin;
+  std::streamoff scanned;
+  State state;
+
+  // Reused buffer for scanning
+  std::vector<char> buffer;
+
+  // Reader, created when the header is complete
+  std::unique_ptr<csvstream> csvin;
+
+  // Number of complete rows not yet read, including the header before csvin
+  // exists
+  size_t pending;
+
+  // Number of data rows read from the open file
+  size_t line_no;
+
+  // Disable copying
+  csvfollow(const csvfollow &);
+  csvfollow & operator= (const csvfollow &);
+
+  // Open the file, or reopen it after a rotation
+  void open() {
+    struct stat st;
+    if (fin.is_open()) fin.close();
+    fin.clear();
+    fin.open(filename.c_str(), std::ios::binary);
+    if (!fin.is_open() || stat(filename.c_str(), &st) != 0) {
+      throw csvstream_exception("Error opening file: " + filename);
+    }
+    dev = st.st_dev;
+    ino = st.st_ino;
+    scanned = 0;
+    state = START;
+    csvin.reset();
+    pending = 0;
+    line_no = 0;
+  }
+
+  // Return true if the filename now refers to a different or shorter file
+  bool replaced() const {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) return false;
+    return st.st_dev != dev || st.st_ino != ino || st.st_size < scanned;
+  }
+
+  // Look for new complete rows.  When the open file has no more rows and has
+  // been replaced, switch to the new file.  A partly written last row of the
+  // old file is dropped.
+  void update() {
+    scan();
+    if (!pending && replaced()) {
+      open();
+      nrotations += 1;
+      scan();
+    }
+    if (csvin || !pending) return;
+
+    // The header is complete
+    csvin.reset(new csvstream(filename, delimiter, strict));
+    pending -= 1;
+    if (replaced()) {
+      // The file was replaced between opening it and reading the header
+      open();
+      nrotations += 1;
+      return;
+    }
+    if (header.empty()) {
+      header = csvin->getheader();
+    } else if (csvin->getheader() != header) {
+      throw csvstream_exception("Header does not match first file. " +
+                                filename);
+    }
+  }
+
+  // Scan bytes written since the last scan, counting complete rows
+  void scan() {
+    // If every row has been read, csvin may have stopped before or after a
+    // '\n' that ends the last row, depending on whether it had been written.
+    // Move it to the start of the next row once that's known.
+    bool resync = csvin && !pending && (state == END || state == START);
+
+    std::streamoff pos = scanned;
+    fin.clear();
+    fin.seekg(scanned);
+    while (fin) {
+      fin.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+      std::streamsize n = fin.gcount();
+      for (std::streamsize i=0; i<n; ++i, ++pos) {
+        char c = buffer[static_cast<size_t>(i)];
+        if (state == END) {
+          // A line ending is followed by at most one more '\n'
+          state = START;
+          if (c == '\n') continue;
+        }
+        if (state == START) {
+          if (resync) csvin->seek(pos, line_no);
+          resync = false;
+          state = UNQUOTED;
+        }
+        switch (state) {
+        case UNQUOTED:
+          if (c == '"') state = QUOTED;
+          else if (c == '\\') state = UNQUOTED_ESCAPED;
+          else if (c == '\n' || c == '\r') {
+            state = END;
+            pending += 1;
+          }
+          break;
+        case UNQUOTED_ESCAPED:
+          state = UNQUOTED;
+          break;
+        case QUOTED:
+          if (c == '"') state = UNQUOTED;
+          else if (c == '\\') state = QUOTED_ESCAPED;
+          break;
+        case QUOTED_ESCAPED:
+          state = QUOTED;
+          break;
+        default:
+          break;
+        }
+      }
+    }
+    scanned = pos;
+  }
+
+  // Watch the file's directory, which also sees the file being replaced
+  void watch() {
+#ifdef __linux__
+    std::string dir = ".";
+    size_t slash = filename.rfind('/');
+    if (slash == 0) dir = "/";
+    else if (slash != std::string::npos) dir = filename.substr(0, slash);
+    notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notify_fd < 0) return;
+    uint32_t mask = IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_DELETE;
+    if (inotify_add_watch(notify_fd, dir.c_str(), mask) < 0) {
+      close(notify_fd);
+      notify_fd = -1;
+    }
+#endif
+  }
+
+  // Sleep until the directory changes, or at most timeout
+  void wait(duration timeout) {
+    timeout = std::min(timeout, poll_interval);
+#ifdef __linux__
+    if (notify_fd >= 0) {
+      struct pollfd p;
+      p.fd = notify_fd;
+      p.events = POLLIN;
+      p.revents = 0;
+      if (poll(&p, 1, static_cast<int>(timeout.count())) > 0) {
+        // Discard the events.  Any change is a reason to look again.
+        char events[4096];
+        while (::read(notify_fd, events, sizeof(events)) > 0) {}
+      }
+      return;
+    }
+#endif
+    std::this_thread::sleep_for(timeout);
+  }
+};
+
+#endif
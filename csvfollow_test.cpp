@@ -0,0 +1,212 @@
+/* csvfollow_test.cpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ */
+
+#include "csvfollow.hpp"
+#include "csvtest.hpp"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+using namespace std;
+
+
+void test_follow();
+void test_follow_partial_row();
+void test_follow_split_line_ending();
+void test_follow_truncate();
+void test_follow_rotate();
+void test_follow_header_mismatch();
+void test_follow_wakeup();
+
+
+const string filename = "csvfollow_test.csv";
+const csvfollow::duration no_wait(0);
+
+
+int main() {
+  test_follow();
+  test_follow_partial_row();
+  test_follow_split_line_ending();
+  test_follow_truncate();
+  test_follow_rotate();
+  test_follow_header_mismatch();
+  test_follow_wakeup();
+  remove(filename.c_str());
+  cout << "csvfollow_test PASSED\n";
+  return 0;
+}
+
+
+// Append a string to a file
+void append_file(const string &name, const string &contents) {
+  ofstream fout(name.c_str(), ios::binary | ios::app);
+  assert(fout.is_open());
+  fout << contents;
+}
+
+
+// Read every complete row written so far, without waiting
+vector<vector<string>> read_available(csvfollow &follow) {
+  vector<vector<string>> rows;
+  vector<string> row;
+  while (follow.read(row, no_wait)) rows.push_back(row);
+  return rows;
+}
+
+
+void test_follow() {
+  // Test reading rows as they're appended
+  write_file(filename, "name,animal\nFergie,horse\n");
+  csvfollow follow(filename);
+  assert(follow.getheader() == vector<string>({"name", "animal"}));
+
+  map<string, string> row;
+  follow.read(row, no_wait);
+  assert(row["name"] == "Fergie");
+  vector<vector<string>> output_observed = read_available(follow);
+  assert(output_observed.empty());
+
+  append_file(filename, "Myrtle II,chicken\nOscar,cat\n");
+  output_observed = read_available(follow);
+  assert(output_observed == vector<vector<string>>(
+           {{"Myrtle II", "chicken"}, {"Oscar", "cat"}}));
+  assert(follow.rotations() == 0);
+}
+
+
+void test_follow_partial_row() {
+  // Test that rows and the header aren't read until their line ending is
+  // written, including a line ending inside quotes
+  write_file(filename, "name,ani");
+  csvfollow follow(filename);
+  assert(follow.getheader().empty());
+
+  vector<vector<string>> output_observed = read_available(follow);
+  assert(output_observed.empty());
+  append_file(filename, "mal\nFergie,\"hor");
+  output_observed = read_available(follow);
+  assert(output_observed.empty());
+  assert(follow.getheader() == vector<string>({"name", "animal"}));
+
+  append_file(filename, "se\n");
+  output_observed = read_available(follow);
+  assert(output_observed.empty());
+  append_file(filename, "and pony\"\nOscar,c");
+  output_observed = read_available(follow);
+  assert(output_observed == vector<vector<string>>(
+           {{"Fergie", "horse\nand pony"}}));
+
+  append_file(filename, "at\n");
+  output_observed = read_available(follow);
+  assert(output_observed == vector<vector<string>>({{"Oscar", "cat"}}));
+}
+
+
+void test_follow_split_line_ending() {
+  // Test a Windows line ending written in two pieces.  The '\n' is part of
+  // the line ending, not an empty row.
+  write_file(filename, "name,animal\r");
+  csvfollow follow(filename);
+  vector<vector<string>> output_observed = read_available(follow);
+  assert(output_observed.empty());
+
+  append_file(filename, "\nFergie,horse\r");
+  output_observed = read_available(follow);
+  assert(output_observed == vector<vector<string>>({{"Fergie", "horse"}}));
+
+  append_file(filename, "\n");
+  output_observed = read_available(follow);
+  assert(output_observed.empty());
+  append_file(filename, "Oscar,cat\r\n");
+  output_observed = read_available(follow);
+  assert(output_observed == vector<vector<string>>({{"Oscar", "cat"}}));
+}
+
+
+void test_follow_truncate() {
+  // Test a file truncated and rewritten in place
+  write_file(filename, "name,animal\nFergie,horse\nMyrtle II,chicken\n");
+  csvfollow follow(filename);
+  vector<vector<string>> output_observed = read_available(follow);
+  assert(output_observed.size() == 2);
+
+  write_file(filename, "name,animal\nOscar,cat\n");
+  output_observed = read_available(follow);
+  assert(output_observed == vector<vector<string>>({{"Oscar", "cat"}}));
+  assert(follow.rotations() == 1);
+}
+
+
+void test_follow_rotate() {
+  // Test a file renamed and replaced.  Rows appended to the old file before
+  // it was replaced are read first.
+  const string old_filename = filename + ".1";
+  write_file(filename, "name,animal\nFergie,horse\n");
+  csvfollow follow(filename);
+  vector<vector<string>> output_observed = read_available(follow);
+  assert(output_observed.size() == 1);
+
+  append_file(filename, "Myrtle II,chicken\nBella,");
+  rename(filename.c_str(), old_filename.c_str());
+  assert(ifstream(old_filename.c_str()).is_open());
+  write_file(filename, "name,animal\nOscar,cat\n");
+
+  output_observed = read_available(follow);
+  assert(output_observed == vector<vector<string>>(
+           {{"Myrtle II", "chicken"}, {"Oscar", "cat"}}));
+  assert(follow.rotations() == 1);
+  remove(old_filename.c_str());
+}
+
+
+void test_follow_header_mismatch() {
+  // Test error condition: a replacement file with a different header
+  write_file(filename, "name,animal\nFergie,horse\n");
+  csvfollow follow(filename);
+  vector<vector<string>> output_observed = read_available(follow);
+  assert(output_observed.size() == 1);
+  vector<string> row;
+  remove(filename.c_str());
+  write_file(filename, "name,species\nOscar,cat\n");
+  try {
+    follow.read(row, no_wait);
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()).find("Header does not match") != string::npos);
+  }
+}
+
+
+void test_follow_wakeup() {
+  // Test that a waiting reader sees a row soon after it's written, without
+  // waiting for the poll interval when inotify is available
+  write_file(filename, "name,animal\n");
+#ifdef __linux__
+  csvfollow::duration poll_interval(60 * 1000);
+#else
+  csvfollow::duration poll_interval(10);
+#endif
+  csvfollow follow(filename, ',', true, poll_interval);
+
+  thread writer([]() {
+    this_thread::sleep_for(chrono::milliseconds(50));
+    append_file(filename, "Fergie,horse\n");
+  });
+  auto start = chrono::steady_clock::now();
+  vector<string> row;
+  bool ok = follow.read(row, csvfollow::duration(30 * 1000));
+  auto elapsed = chrono::steady_clock::now() - start;
+  writer.join();
+  assert(ok);
+  assert(row == vector<string>({"Fergie", "horse"}));
+  assert(elapsed < chrono::seconds(10));
+}
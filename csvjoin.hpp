@@ -0,0 +1,277 @@
+/* -*- mode: c++ -*- */
+#ifndef CSVJOIN_HPP
+#define CSVJOIN_HPP
+/* csvjoin.hpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ *
+ * Hash join of two CSV inputs.  The smaller "build" input is loaded into a
+ * hash table on its key column.  The larger "probe" input is streamed one row
+ * at a time, and each row is combined with the build rows that have the same
+ * key.
+ */
+
+#include "csvstream.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <cstring>
+#include <cstdint>
+
+
+// csvjoin interface
+class csvjoin {
+public:
+  // INNER emits only probe rows with a match.  LEFT also emits probe rows
+  // without a match, with empty build columns.
+  enum join_type {INNER, LEFT};
+
+  // Load the build input into a hash table on build_key, keeping only
+  // build_columns.  Rows are then read from probe, matched on probe_key, and
+  // combined.  Output columns are probe_columns followed by build_columns.
+  // Throws csvstream_exception if a column doesn't exist.
+  csvjoin(csvstream &build,
+          const std::string &build_key,
+          const std::vector<std::string> &build_columns,
+          csvstream &probe,
+          const std::string &probe_key,
+          const std::vector<std::string> &probe_columns,
+          join_type type=INNER)
+    : probe(probe),
+      type(type),
+      nrows(0),
+      probe_key_col(find_columns(probe.getheader(), {probe_key})[0]),
+      probe_cols(find_columns(probe.getheader(), probe_columns)),
+      build_cols(find_columns(build.getheader(), build_columns)),
+      match(0),
+      match_last(0),
+      unmatched(false) {
+
+    // Output header
+    header = probe_columns;
+    header.insert(header.end(), build_columns.begin(), build_columns.end());
+
+    // Store the key as the first field of each build row
+    std::vector<size_t> cols = build_cols;
+    cols.insert(cols.begin(), find_columns(build.getheader(), {build_key})[0]);
+    nfields = cols.size();
+
+    // Load build rows.  Only the stored columns are decoded.
+    slots.assign(16, 0);
+    offsets.push_back(0);
+    csvrow row;
+    while (build >> row) {
+      for (size_t c : cols) {
+        pool += row[c];
+        offsets.push_back(pool.size());
+      }
+      if (nrows == UINT32_MAX) {
+        throw csvstream_exception("Too many rows in build input");
+      }
+      nrows += 1;
+      next.push_back(static_cast<uint32_t>(nrows));
+      insert(nrows);
+    }
+  }
+
+  // Return false when there are no more output rows
+  explicit operator bool() const {
+    return static_cast<bool>(probe);
+  }
+
+  // Return output column names, probe columns followed by build columns
+  const std::vector<std::string> & getheader() const {
+    return header;
+  }
+
+  // Return number of rows in the build input
+  size_t build_size() const {
+    return nrows;
+  }
+
+  // Return approximate bytes of memory used by the build hash table
+  size_t memory_usage() const {
+    return pool.capacity() +
+      offsets.capacity() * sizeof(size_t) +
+      next.capacity() * sizeof(uint32_t) +
+      slots.capacity() * sizeof(uint32_t);
+  }
+
+  // Stream extraction operator reads one output row of values
+  csvjoin & operator>> (std::vector<std::string>& row) {
+    if (!advance()) {
+      row.clear();
+      return *this;
+    }
+    row.resize(header.size());
+    for (size_t i=0; i<probe_cols.size(); ++i) {
+      row[i] = probe_row[probe_cols[i]];
+    }
+    for (size_t i=0; i<build_cols.size(); ++i) {
+      size_t j = probe_cols.size() + i;
+      if (unmatched) {
+        row[j].clear();
+      } else {
+        row[j].assign(field(match, i + 1), field_size(match, i + 1));
+      }
+    }
+    return *this;
+  }
+
+  // Stream extraction operator reads one output row, keeping column order
+  csvjoin & operator>> (std::vector<std::pair<std::string, std::string> >& row) {
+    std::vector<std::string> values;
+    *this >> values;
+    row.clear();
+    for (size_t i=0; i<values.size(); ++i) {
+      row.push_back(make_pair(header[i], values[i]));
+    }
+    return *this;
+  }
+
+  // Stream extraction operator reads one output row into a map.  If the
+  // probe and build columns share a name, the build value is kept.
+  csvjoin & operator>> (std::map<std::string, std::string>& row) {
+    std::vector<std::string> values;
+    *this >> values;
+    row.clear();
+    for (size_t i=0; i<values.size(); ++i) {
+      row[header[i]] = values[i];
+    }
+    return *this;
+  }
+
+private:
+  // Probe input
+  csvstream &probe;
+
+  // Inner or left join
+  join_type type;
+
+  // Output column names
+  std::vector<std::string> header;
+
+  // Number of build rows
+  size_t nrows;
+
+  // Number of fields stored for each build row, including the key
+  size_t nfields;
+
+  // Index of the key column in the probe input
+  size_t probe_key_col;
+
+  // Indices of output columns in each input
+  std::vector<size_t> probe_cols;
+  std::vector<size_t> build_cols;
+
+  // All stored build values, concatenated
+  std::string pool;
+
+  // Field j of build row r (counting from 1) is
+  // pool[offsets[(r-1)*nfields + j] .. offsets[(r-1)*nfields + j + 1])
+  std::vector<size_t> offsets;
+
+  // Open addressing hash table of build rows, 0 means an empty slot.  Rows
+  // with equal keys are linked by next in a circular list in input order.
+  // Each slot holds the last row of its list, so next of the slot's row is
+  // the first.
+  std::vector<uint32_t> slots;
+  std::vector<uint32_t> next;
+
+  // Current probe row, current matching build row or 0, and the last row
+  // with an equal key.  The probe row is decoded lazily, so only the key and
+  // output columns are copied out of the raw text.
+  csvrow probe_row;
+  uint32_t match;
+  uint32_t match_last;
+
+  // True when the current probe row has no match in a left join
+  bool unmatched;
+
+  // Return indices of named columns.  Throws csvstream_exception if a column
+  // doesn't exist.
+  static std::vector<size_t> find_columns(const std::vector<std::string> &header,
+                                          const std::vector<std::string> &names) {
+    std::vector<size_t> indices;
+    for (auto &name : names) {
+      size_t i = 0;
+      while (i < header.size() && header[i] != name) ++i;
+      if (i == header.size()) {
+        throw csvstream_exception("No such column: " + name);
+      }
+      indices.push_back(i);
+    }
+    return indices;
+  }
+
+  // Return a pointer to field j of build row r
+  const char * field(size_t r, size_t j) const {
+    return pool.data() + offsets[(r - 1) * nfields + j];
+  }
+
+  // Return the size of field j of build row r
+  size_t field_size(size_t r, size_t j) const {
+    size_t k = (r - 1) * nfields + j;
+    return offsets[k + 1] - offsets[k];
+  }
+
+  // Return true if build row r has key
+  bool key_equal(size_t r, const char *key, size_t size) const {
+    return field_size(r, 0) == size &&
+      std::memcmp(field(r, 0), key, size) == 0;
+  }
+
+  // Return the slot for a key, which is empty or holds the last row with an
+  // equal key
+  size_t find_slot(const char *key, size_t size) const {
+    size_t mask = slots.size() - 1;
+    size_t i = static_cast<size_t>(csvstream_hash(key, size)) & mask;
+    while (slots[i] && !key_equal(slots[i], key, size)) {
+      i = (i + 1) & mask;
+    }
+    return i;
+  }
+
+  // Add build row r to the hash table
+  void insert(size_t r) {
+    // Grow the table to keep it at most half full
+    if (2 * nrows > slots.size()) {
+      std::vector<uint32_t> old(2 * slots.size(), 0);
+      old.swap(slots);
+      for (uint32_t last : old) {
+        if (last) slots[find_slot(field(last, 0), field_size(last, 0))] = last;
+      }
+    }
+
+    // Add to the end of the list of rows with an equal key
+    uint32_t row = static_cast<uint32_t>(r);
+    size_t i = find_slot(field(r, 0), field_size(r, 0));
+    if (slots[i]) {
+      next[r - 1] = next[slots[i] - 1];
+      next[slots[i] - 1] = row;
+    }
+    slots[i] = row;
+  }
+
+  // Move to the next output row.  Return false at the end of the probe input.
+  bool advance() {
+    if (match && match != match_last) {
+      match = next[match - 1];
+      return true;
+    }
+    while (true) {
+      if (!(probe >> probe_row)) return false;
+      const std::string &key = probe_row[probe_key_col];
+      match_last = slots[find_slot(key.data(), key.size())];
+      match = match_last ? next[match_last - 1] : 0;
+      unmatched = !match && type == LEFT;
+      if (match || unmatched) return true;
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,158 @@
+/* csvjoin_test.cpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ */
+
+#include "csvjoin.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+using namespace std;
+
+
+void test_inner_join();
+void test_left_join();
+void test_join_many_keys();
+void test_join_no_such_column();
+
+
+int main() {
+  test_inner_join();
+  test_left_join();
+  test_join_many_keys();
+  test_join_no_such_column();
+  cout << "csvjoin_test PASSED\n";
+  return 0;
+}
+
+
+// data for next few unit tests
+const string input_animals =
+  "name,species,age\nFergie,horse,5\nMyrtle II,chicken,2\n"
+  "Oscar,cat,9\nNemo,fish,1\nBella,cat,3\n";
+const string input_species =
+  "species,sound,legs\nhorse,neigh,4\ncat,meow,4\nchicken,cluck,2\n"
+  "cat,purr,4\n";
+
+
+void test_inner_join() {
+  // Test inner join, including a key with two build rows and a probe row
+  // without a match
+
+  // Correct answer
+  const vector<vector<string>> output_correct =
+    {
+      {"Fergie","neigh"},
+      {"Myrtle II","cluck"},
+      {"Oscar","meow"},
+      {"Oscar","purr"},
+      {"Bella","meow"},
+      {"Bella","purr"},
+    }
+  ;
+
+  // Save actual output
+  vector<vector<string>> output_observed;
+
+  // Join
+  stringstream build_iss(input_species);
+  stringstream probe_iss(input_animals);
+  csvstream build(build_iss);
+  csvstream probe(probe_iss);
+  csvjoin join(build, "species", {"sound"}, probe, "species", {"name"});
+  assert(join.getheader() == vector<string>({"name", "sound"}));
+  assert(join.build_size() == 4);
+  vector<string> row;
+  while (join >> row) {
+    output_observed.push_back(row);
+  }
+
+  // Check output
+  assert(output_observed == output_correct);
+}
+
+
+void test_left_join() {
+  // Test left join, which keeps probe rows without a match
+
+  // Correct answer
+  const vector<map<string, string>> output_correct =
+    {
+      {{"name","Fergie"},{"legs","4"},{"sound","neigh"}},
+      {{"name","Myrtle II"},{"legs","2"},{"sound","cluck"}},
+      {{"name","Oscar"},{"legs","4"},{"sound","meow"}},
+      {{"name","Oscar"},{"legs","4"},{"sound","purr"}},
+      {{"name","Nemo"},{"legs",""},{"sound",""}},
+      {{"name","Bella"},{"legs","4"},{"sound","meow"}},
+      {{"name","Bella"},{"legs","4"},{"sound","purr"}},
+    }
+  ;
+
+  // Save actual output
+  vector<map<string, string>> output_observed;
+
+  // Join
+  stringstream build_iss(input_species);
+  stringstream probe_iss(input_animals);
+  csvstream build(build_iss);
+  csvstream probe(probe_iss);
+  csvjoin join(build, "species", {"sound", "legs"},
+               probe, "species", {"name"}, csvjoin::LEFT);
+  map<string, string> row;
+  while (join >> row) {
+    output_observed.push_back(row);
+  }
+
+  // Check output
+  assert(output_observed == output_correct);
+}
+
+
+void test_join_many_keys() {
+  // Test a build input large enough to grow the hash table several times
+
+  stringstream build_iss;
+  build_iss << "id,square\n";
+  for (int i=0; i<5000; ++i) build_iss << i << "," << i * i << "\n";
+  stringstream probe_iss;
+  probe_iss << "x\n";
+  for (int i=-100; i<10000; i+=7) probe_iss << i << "\n";
+
+  csvstream build(build_iss);
+  csvstream probe(probe_iss);
+  csvjoin join(build, "id", {"square"}, probe, "x", {"x"});
+  vector<pair<string, string>> row;
+  int expected = 0;
+  while (join >> row) {
+    while (expected < 0 || expected % 7 != 5) ++expected;
+    assert(row[0].second == to_string(expected));
+    assert(row[1].first == "square");
+    assert(row[1].second == to_string(expected * expected));
+    ++expected;
+  }
+  assert(expected == 4997);
+}
+
+
+void test_join_no_such_column() {
+  // Test error condition: a key column doesn't exist
+
+  stringstream build_iss(input_species);
+  stringstream probe_iss(input_animals);
+  csvstream build(build_iss);
+  csvstream probe(probe_iss);
+  try {
+    csvjoin join(build, "species", {"sound"}, probe, "kind", {"name"});
+  } catch(const csvstream_exception &e) {
+    //if we caught an exception, then it worked
+    return;
+  }
+
+  // if we made it this far, then it didn't work
+  assert(0);
+}
@@ -0,0 +1,346 @@
+/* -*- mode: c++ -*- */
+#ifndef CSVSAMPLE_HPP
+#define CSVSAMPLE_HPP
+/* csvsample.hpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ *
+ * Sample rows of a large file by seeking to random byte offsets.  A random
+ * offset can land inside a quoted value that spans lines, so the start of
+ * the next row is found by scanning ahead twice: once assuming the offset is
+ * outside quotes and once assuming it's inside.  The guess whose next few
+ * rows have the header's number of values and well placed quotes wins.  Only
+ * a window of a few rows after each offset is read.
+ */
+
+#include "csvstream.hpp"
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <algorithm>
+#include <random>
+#include <cstdint>
+
+
+// csvsample interface
+class csvsample {
+public:
+  // Open a file and read its header.  Throws csvstream_exception if the file
+  // can't be read.
+  csvsample(const std::string &filename,
+            char delimiter=',',
+            bool strict=true,
+            uint64_t seed=0)
+    : filename(filename),
+      delimiter(delimiter),
+      strict(strict),
+      rng(seed),
+      file_size(0),
+      data_start(0),
+      window(0),
+      buf_offset(0),
+      nbytes_read(0),
+      nskipped(0) {
+    // Read the header with a csvstream to find where the rows start
+    {
+      csvstream in(filename, delimiter, strict);
+      header = in.getheader();
+      data_start = in.checkpoint().offset;
+    }
+
+    fin.open(filename.c_str(), std::ios::binary);
+    if (!fin.is_open()) {
+      throw csvstream_exception("Error opening file: " + filename);
+    }
+    fin.seekg(0, std::ios::end);
+    file_size = static_cast<uint64_t>(fin.tellg());
+    size_t header_size = static_cast<size_t>(data_start);
+    if (!read(0, header_size + probe_size)) {
+      throw csvstream_exception("Error reading file: " + filename);
+    }
+
+    // Size the read window from the average length of the first rows
+    size_t pos = header_size;
+    size_t n = 0;
+    record_scan r;
+    while (n < probe_rows && pos < buf.size() && scan(pos, false, r)) {
+      pos = r.end;
+      n += 1;
+    }
+    size_t row_size = n ? (pos - header_size) / n : buf.size() - header_size;
+    window = std::max(size_t(min_window), window_rows * row_size);
+
+    // Each sampled row is parsed by a csvstream reading from a string that
+    // holds just that row
+    rows_in.str(buf.substr(0, header_size));
+    parser.reset(new csvstream(rows_in, delimiter, strict));
+  }
+
+  // Return header of the file
+  std::vector<std::string> getheader() const {
+    return header;
+  }
+
+  // Replace rows with a sample of up to nrows distinct rows, in file order,
+  // and return the number of rows sampled.  The row after each random offset
+  // is sampled, so a row's chance of being sampled is proportional to the
+  // length of the row before it.  That's uniform when rows have similar
+  // lengths.  Fewer rows are returned if the file is small or a row boundary
+  // can't be found.  Works with the same row types as csvstream.
+  template <typename Row>
+  size_t sample(size_t nrows, std::vector<Row> &rows) {
+    std::set<uint64_t> starts;
+    std::vector<std::pair<uint64_t, Row> > sampled;
+    if (file_size == data_start) nrows = 0;
+
+    // Repeat with new offsets if some offsets landed on the same row
+    for (size_t round=0; round<8 && sampled.size() < nrows; ++round) {
+      std::uniform_int_distribution<uint64_t> dist(0, file_size - 1);
+      std::vector<uint64_t> offsets(nrows - sampled.size());
+      for (auto &offset : offsets) offset = dist(rng);
+      std::sort(offsets.begin(), offsets.end());
+
+      for (uint64_t offset : offsets) {
+        uint64_t start = 0;
+        std::string record;
+        if (!find_row(offset, start, record)) continue;
+        if (!starts.insert(start).second) continue;
+        sampled.emplace_back(start, Row());
+        parse(record, sampled.back().second);
+      }
+    }
+
+    std::sort(sampled.begin(), sampled.end(),
+              [](const std::pair<uint64_t, Row> &a,
+                 const std::pair<uint64_t, Row> &b) {
+                return a.first < b.first;
+              });
+    rows.clear();
+    for (auto &p : sampled) rows.push_back(std::move(p.second));
+    return rows.size();
+  }
+
+  // Return the total number of bytes read from the file
+  uint64_t bytes_read() const {
+    return nbytes_read;
+  }
+
+  // Return the number of offsets where no row boundary could be found
+  size_t skipped() const {
+    return nskipped;
+  }
+
+  // Return the bytes read after each offset at first.  The window doubles,
+  // up to max_window, while the row boundary after an offset is uncertain.
+  size_t initial_window() const {
+    return window;
+  }
+
+  // The first window holds window_rows rows of the average length of the
+  // first probe_rows rows, which are read from the first probe_size bytes
+  static const size_t window_rows = 6;
+  static const size_t probe_rows = 16;
+  static const size_t probe_size = 4 << 10;
+  static const size_t min_window = 64;
+  static const size_t max_window = 16 << 20;
+
+  // Number of rows after a boundary that must look right
+  static const size_t check_rows = 3;
+
+private:
+  // Where one record of the buffer ends, how many values it has, and whether
+  // its quotes only open at the start of a value and close at the end
+  struct record_scan {
+    size_t end;
+    size_t fields;
+    bool clean;
+  };
+
+  // Whether the rows after a guessed boundary look right
+  enum guess_status {VALID, INVALID, UNKNOWN};
+
+  std::string filename;
+  std::vector<std::string> header;
+  char delimiter;
+  bool strict;
+  std::mt19937_64 rng;
+
+  // Input and its size
+  std::ifstream fin;
+  uint64_t file_size;
+
+  // Offset of the first row
+  uint64_t data_start;
+
+  // Bytes read after each offset at first
+  size_t window;
+
+  // Bytes of the file starting at buf_offset
+  std::string buf;
+  uint64_t buf_offset;
+
+  // Parser for one row at a time
+  std::istringstream rows_in;
+  std::unique_ptr<csvstream> parser;
+
+  // Statistics
+  uint64_t nbytes_read;
+  size_t nskipped;
+
+  // Disable copying
+  csvsample(const csvsample &);
+  csvsample & operator= (const csvsample &);
+
+  // Make buf hold size bytes starting at offset, or up to the end of the
+  // file.  Reuse the current buffer if it already does.
+  bool read(uint64_t offset, size_t size) {
+    uint64_t end = std::min(file_size, offset + size);
+    if (offset >= buf_offset && end <= buf_offset + buf.size()) return true;
+    buf.resize(static_cast<size_t>(end - offset));
+    fin.clear();
+    fin.seekg(static_cast<std::streamoff>(offset));
+    fin.read(&buf[0], static_cast<std::streamsize>(buf.size()));
+    nbytes_read += static_cast<uint64_t>(fin.gcount());
+    buf_offset = offset;
+    return static_cast<size_t>(fin.gcount()) == buf.size();
+  }
+
+  // Return true if buf reaches the end of the file
+  bool at_eof() const {
+    return buf_offset + buf.size() == file_size;
+  }
+
+  // Scan one record of buf starting at pos, the same way
+  // csvstream::read_csv_record() tokenizes, with the given initial quote
+  // state.  Return false if buf ends before the record does.
+  bool scan(size_t pos, bool quoted, record_scan &r) const {
+    r.fields = 1;
+    r.clean = true;
+    bool value_start = !quoted;
+    size_t i = pos;
+    while (i < buf.size()) {
+      char c = buf[i++];
+      if (c == '\\') {
+        // Escaped character
+        i += 1;
+      } else if (quoted) {
+        if (c == '"') {
+          // A closing quote ends a value, or is the first of a pair
+          quoted = false;
+          if (i < buf.size() && buf[i] != delimiter && buf[i] != '"' &&
+              buf[i] != '\n' && buf[i] != '\r') {
+            r.clean = false;
+          }
+        }
+      } else if (c == '"') {
+        // An opening quote starts a value, or is the second of a pair
+        quoted = true;
+        if (!value_start && buf[i - 2] != '"') r.clean = false;
+      } else if (c == delimiter) {
+        r.fields += 1;
+        value_start = true;
+        continue;
+      } else if (c == '\n' || c == '\r') {
+        // A '\n' after any line ending is consumed with it
+        if (i == buf.size() && !at_eof()) return false;
+        if (i < buf.size() && buf[i] == '\n') i += 1;
+        r.end = i;
+        return true;
+      }
+      value_start = false;
+    }
+    if (!at_eof() || i > buf.size()) return false;
+
+    // The last record of a file may not have a line ending
+    r.end = buf.size();
+    r.clean = r.clean && !quoted;
+    return true;
+  }
+
+  // Return whether a record has the right number of values and clean quotes
+  bool valid(const record_scan &r) const {
+    return r.clean && (!strict || r.fields == header.size());
+  }
+
+  // Guess the first row boundary after pos, with the given quote state at
+  // pos.  On success, boundary is the boundary and end is the end of the row
+  // starting there.  A boundary at the end of the file means there's no row
+  // after pos.
+  guess_status guess(size_t pos, bool quoted, size_t &boundary,
+                     size_t &end) const {
+    record_scan r;
+    if (!scan(pos, quoted, r)) return UNKNOWN;
+    if (!r.clean) return INVALID;
+    boundary = r.end;
+    end = r.end;
+    for (size_t n=0; n<check_rows && r.end < buf.size(); ++n) {
+      if (!scan(r.end, false, r)) return UNKNOWN;
+      if (!valid(r)) return INVALID;
+      if (n == 0) end = r.end;
+    }
+    return VALID;
+  }
+
+  // Find the first row starting at or after offset.  Return false if there
+  // isn't one, or it can't be found.
+  bool find_row(uint64_t offset, uint64_t &start, std::string &record) {
+    offset = std::max(offset, data_start);
+    for (size_t size=window; size<=max_window; size*=2) {
+      if (!read(offset, size)) break;
+      size_t pos = static_cast<size_t>(offset - buf_offset);
+      size_t boundary = 0;
+      size_t end = 0;
+      guess_status status = VALID;
+      if (offset == data_start) {
+        // The first row starts right after the header
+        record_scan r;
+        if (!scan(pos, false, r)) continue;
+        boundary = pos;
+        end = r.end;
+      } else {
+        // Guess that offset is outside quotes, then inside
+        size_t boundary2 = 0;
+        size_t end2 = 0;
+        guess_status outside = guess(pos, false, boundary, end);
+        guess_status inside = guess(pos, true, boundary2, end2);
+        if (outside == VALID) {
+          status = VALID;
+        } else if (inside == VALID) {
+          status = VALID;
+          boundary = boundary2;
+          end = end2;
+        } else if (outside == UNKNOWN || inside == UNKNOWN) {
+          status = UNKNOWN;
+        } else {
+          status = INVALID;
+        }
+      }
+
+      if (status == UNKNOWN) continue;
+      if (status == INVALID) break;
+      if (boundary == buf.size()) return false;
+      start = buf_offset + boundary;
+      record.assign(buf, boundary, end - boundary);
+      return true;
+    }
+    nskipped += 1;
+    return false;
+  }
+
+  // Parse one record into a row
+  template <typename Row>
+  void parse(const std::string &record, Row &row) {
+    rows_in.clear();
+    rows_in.str(record);
+    parser->seek(0, 0);
+    *parser >> row;
+  }
+};
+
+#endif
@@ -0,0 +1,164 @@
+/* csvsample_test.cpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ */
+
+#include "csvsample.hpp"
+#include "csvtest.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdio>
+using namespace std;
+
+
+void test_sample();
+void test_sample_multiline();
+void test_sample_small_file();
+void test_sample_bytes_read();
+void test_sample_row_types();
+void test_sample_error();
+
+
+const string filename = "csvsample_test.csv";
+
+
+int main() {
+  test_sample();
+  test_sample_multiline();
+  test_sample_small_file();
+  test_sample_bytes_read();
+  test_sample_row_types();
+  test_sample_error();
+  remove(filename.c_str());
+  cout << "csvsample_test PASSED\n";
+  return 0;
+}
+
+
+// Return the expected values of row id of a multiline file.  The second
+// value has lines that look like rows with the right number of values.
+// Quotes are removed when it's read.
+vector<string> multiline_row(size_t id) {
+  return {to_string(id), "note " + to_string(id) + "\na,b,c\nx,y,z\nend",
+          "tail"};
+}
+
+
+void test_sample() {
+  // Test that sampled rows are distinct, whole and in file order
+  string contents = "id,name,animal\n";
+  for (size_t i=0; i<1000; ++i) {
+    contents += to_string(i) + ",name " + to_string(i) + ",cat\r\n";
+  }
+  write_file(filename, contents);
+
+  csvsample sampler(filename, ',', true, 1);
+  assert(sampler.getheader() == vector<string>({"id", "name", "animal"}));
+  vector<vector<string>> rows;
+  sampler.sample(100, rows);
+  assert(rows.size() == 100);
+  long last = -1;
+  for (auto &row : rows) {
+    long id = stol(row[0]);
+    assert(id > last);
+    last = id;
+    assert(row == vector<string>({row[0], "name " + row[0], "cat"}));
+  }
+  assert(sampler.skipped() == 0);
+}
+
+
+void test_sample_multiline() {
+  // Test resynchronizing after offsets inside quoted values that span lines
+  string contents = "id,note,tail\n";
+  for (size_t i=0; i<2000; ++i) {
+    contents += to_string(i) + ",\"note " + to_string(i) +
+      "\na,b,c\n\"\"x\"\",y,z\nend\",tail\n";
+  }
+  write_file(filename, contents);
+
+  csvsample sampler(filename, ',', true, 2);
+  vector<vector<string>> rows;
+  sampler.sample(500, rows);
+  assert(rows.size() == 500);
+  for (auto &row : rows) {
+    assert(row == multiline_row(stoul(row[0])));
+  }
+  assert(sampler.skipped() == 0);
+}
+
+
+void test_sample_small_file() {
+  // Test asking for more rows than the file has, including the first row and
+  // a last row without a line ending
+  write_file(filename, "name,animal\nFergie,horse\nMyrtle II,chicken\n"
+             "Oscar,cat");
+  csvsample sampler(filename);
+  vector<vector<string>> rows;
+  sampler.sample(10, rows);
+  assert(rows.size() == 3);
+  assert(rows[0] == vector<string>({"Fergie", "horse"}));
+  assert(rows[1] == vector<string>({"Myrtle II", "chicken"}));
+  assert(rows[2] == vector<string>({"Oscar", "cat"}));
+
+  // Header only
+  write_file(filename, "name,animal\n");
+  csvsample empty(filename);
+  empty.sample(10, rows);
+  assert(rows.empty());
+}
+
+
+void test_sample_bytes_read() {
+  // Test that the bytes read are a small multiple of the bytes of the rows
+  // sampled, with a read window sized from the length of the first rows
+  string contents = "id,name,animal\n";
+  for (size_t i=0; i<200000; ++i) {
+    contents += to_string(i) + ",name " + to_string(i) + ",\"cat\"\n";
+  }
+  write_file(filename, contents);
+
+  csvsample sampler(filename, ',', true, 3);
+  assert(sampler.initial_window() < 256);
+  vector<vector<string>> rows;
+  sampler.sample(200, rows);
+  assert(rows.size() == 200);
+  size_t sample_bytes = 0;
+  for (auto &row : rows) {
+    // Two delimiters, two quotes and a line ending
+    sample_bytes += row[0].size() + row[1].size() + row[2].size() + 5;
+  }
+  assert(sampler.bytes_read() < 10 * sample_bytes + csvsample::probe_size);
+}
+
+
+void test_sample_row_types() {
+  // Test the other row types
+  write_file(filename, "name,animal\nFergie,horse\nMyrtle II,chicken\n");
+  csvsample sampler(filename);
+  vector<map<string, string>> maps;
+  sampler.sample(10, maps);
+  assert(maps.size() == 2);
+  assert(maps[1]["animal"] == "chicken");
+
+  vector<csvrow> csvrows;
+  sampler.sample(10, csvrows);
+  assert(csvrows.size() == 2);
+  assert(csvrows[0]["name"] == "Fergie");
+}
+
+
+void test_sample_error() {
+  // Test error condition: a file that doesn't exist
+  try {
+    csvsample sampler("csvsample_test_missing.csv");
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()).find("Error opening file") != string::npos);
+  }
+}
@@ -0,0 +1,419 @@
+/* -*- mode: c++ -*- */
+#ifndef CSVSCHEMA_HPP
+#define CSVSCHEMA_HPP
+/* csvschema.hpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ *
+ * Guess the type of each column from a sample of rows.  Each value is
+ * classified with one pass over its characters using a table of character
+ * classes, and only values that look like a type are fully parsed.  The
+ * schema can then convert rows to typed values.
+ */
+
+#include "csvstream.hpp"
+#include "csvsample.hpp"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdint>
+
+
+// csvschema interface
+class csvschema {
+public:
+  // Column types, from most to least specific
+  enum column_type {BOOL, INTEGER, FLOAT, TIMESTAMP, STRING};
+
+  // Sample the first rows, or rows at random byte offsets
+  enum sample_type {FIRST, RANDOM};
+
+  // Inferred type and statistics of one column
+  struct column {
+    std::string name;
+    column_type type;
+    size_t nulls;
+    size_t max_width;
+  };
+
+  // One typed value.  Timestamps are seconds since 1970-01-01 00:00:00 UTC.
+  // Only the member for the column's type is set.
+  struct value {
+    column_type type;
+    bool null;
+    bool b;
+    int64_t i;
+    double f;
+    std::string s;
+  };
+
+  // Infer a schema from the next nrows rows of in
+  csvschema(csvstream &in, size_t nrows=1000) : nsampled(0) {
+    init(in.getheader());
+    std::vector<std::string> row;
+    while (nsampled < nrows && in >> row) add(row);
+  }
+
+  // Infer a schema from a sample of nrows rows of a file.  With RANDOM,
+  // rows are sampled at random byte offsets by csvsample, using seed.
+  csvschema(const std::string &filename,
+            size_t nrows=1000,
+            sample_type sample=FIRST,
+            char delimiter=',',
+            uint64_t seed=0) : nsampled(0) {
+    csvstream in(filename, delimiter);
+    init(in.getheader());
+    if (sample == FIRST) {
+      std::vector<std::string> row;
+      while (nsampled < nrows && in >> row) add(row);
+    } else {
+      sample_random(filename, delimiter, nrows, seed);
+    }
+  }
+
+  // Return the columns, in file order
+  const std::vector<column> & columns() const {
+    return cols;
+  }
+
+  // Return the number of rows sampled
+  size_t sample_size() const {
+    return nsampled;
+  }
+
+  // Return the fraction of sampled values in column col that were null
+  double null_rate(size_t col) const {
+    if (!nsampled) return 0;
+    return static_cast<double>(cols.at(col).nulls) /
+      static_cast<double>(nsampled);
+  }
+
+  // Print one line per column with its type, null rate and maximum width
+  void print(std::ostream &os) const {
+    for (size_t i=0; i<cols.size(); ++i) {
+      os << std::left << std::setw(24) << cols[i].name << std::right
+         << std::setw(10) << type_name(cols[i].type)
+         << std::fixed << std::setprecision(1)
+         << std::setw(8) << 100 * null_rate(i) << "% null"
+         << std::setw(8) << cols[i].max_width << " max width\n";
+    }
+  }
+
+  // Convert a row of values, in column order, to typed values.  Throws
+  // csvstream_exception if a value doesn't match its column's type.
+  void parse(const std::vector<std::string> &row,
+             std::vector<value> &values) const {
+    if (row.size() != cols.size()) {
+      throw csvstream_exception("Number of items in row does not match "
+                                "schema. row.size() = " +
+                                std::to_string(row.size()) + " ");
+    }
+    values.resize(cols.size());
+    for (size_t i=0; i<cols.size(); ++i) {
+      value &v = values[i];
+      const std::string &s = row[i];
+      v.type = cols[i].type;
+      v.null = is_null(s);
+      bool ok = true;
+      switch (v.type) {
+      case BOOL:
+        ok = v.null || parse_bool(s, v.b);
+        break;
+      case INTEGER:
+        ok = v.null || parse_integer(s, v.i);
+        break;
+      case FLOAT:
+        ok = v.null || parse_float(s, v.f);
+        break;
+      case TIMESTAMP:
+        ok = v.null || parse_timestamp(s, v.f);
+        break;
+      case STRING:
+        v.s = s;
+        break;
+      }
+      if (!ok) {
+        throw csvstream_exception("Value does not match column type. "
+                                  "column = " + cols[i].name + " "
+                                  "type = " + type_name(v.type) + " "
+                                  "value = " + s + " ");
+      }
+    }
+  }
+
+  // Return the most specific type of a value that isn't null
+  static column_type classify(const std::string &s) {
+    unsigned types = possible_types(s);
+    for (unsigned t=BOOL; t<STRING; ++t) {
+      if (types & (1u << t)) return static_cast<column_type>(t);
+    }
+    return STRING;
+  }
+
+  // Return true if a value is empty or a common spelling of null
+  static bool is_null(const std::string &s) {
+    return s.empty() || s == "NULL" || s == "null" || s == "NA" || s == "N/A";
+  }
+
+  // Return the name of a type
+  static const char * type_name(column_type type) {
+    static const char * const names[] = {
+      "bool", "integer", "float", "timestamp", "string"
+    };
+    return names[type];
+  }
+
+  // Parse true, false, yes or no in any case
+  static bool parse_bool(const std::string &s, bool &b) {
+    std::string lower(s);
+    for (auto &c : lower) {
+      c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    if (lower == "true" || lower == "yes") b = true;
+    else if (lower == "false" || lower == "no") b = false;
+    else return false;
+    return true;
+  }
+
+  // Parse a decimal integer that fits in 64 bits.  A leading zero, as in a
+  // zip code, makes the value a string.
+  static bool parse_integer(const std::string &s, int64_t &i) {
+    if (!numeric_prefix(s)) return false;
+    char *end = nullptr;
+    errno = 0;
+    long long n = std::strtoll(s.c_str(), &end, 10);
+    if (errno == ERANGE || end != s.c_str() + s.size()) return false;
+    i = n;
+    return true;
+  }
+
+  // Parse a decimal floating point number.  Infinity and NaN are strings.
+  static bool parse_float(const std::string &s, double &f) {
+    if (!numeric_prefix(s)) return false;
+    for (char c : s) {
+      if (!(char_class(c) & (DIGIT | SIGN | DOT | EXP))) return false;
+    }
+    char *end = nullptr;
+    f = std::strtod(s.c_str(), &end);
+    return end == s.c_str() + s.size();
+  }
+
+  // Parse an ISO 8601 date or date and time, like 2024-01-31,
+  // 2024-01-31 13:45, 2024-01-31T13:45:00.250Z or 2024-01-31T13:45:00+02:00.
+  // Slashes may separate the date.  Times without a zone are UTC.
+  static bool parse_timestamp(const std::string &s, double &seconds) {
+    const char *p = s.c_str();
+    const char *end = p + s.size();
+
+    // Read exactly n digits
+    auto digits = [&p, end](int n, int &out) {
+      out = 0;
+      for (int k=0; k<n; ++k, ++p) {
+        if (p == end || !(char_class(*p) & DIGIT)) return false;
+        out = 10 * out + (*p - '0');
+      }
+      return true;
+    };
+
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+    int zone = 0;
+    double fraction = 0;
+    if (!digits(4, year) || p == end || (*p != '-' && *p != '/')) return false;
+    char sep = *p++;
+    if (!digits(2, month) || p == end || *p++ != sep) return false;
+    if (!digits(2, day)) return false;
+
+    if (p != end) {
+      if (*p != 'T' && *p != ' ') return false;
+      ++p;
+      if (!digits(2, hour) || p == end || *p++ != ':') return false;
+      if (!digits(2, minute)) return false;
+      if (p != end && *p == ':') {
+        ++p;
+        if (!digits(2, second)) return false;
+        if (p != end && *p == '.') {
+          const char *start = ++p;
+          for (double scale=0.1; p != end && (char_class(*p) & DIGIT);
+               ++p, scale /= 10) {
+            fraction += (*p - '0') * scale;
+          }
+          if (p == start) return false;
+        }
+      }
+      if (p != end && *p == 'Z') {
+        ++p;
+      } else if (p != end && (*p == '+' || *p == '-')) {
+        int sign = *p++ == '-' ? -1 : 1;
+        int zone_hour = 0, zone_minute = 0;
+        if (!digits(2, zone_hour)) return false;
+        if (p != end && *p == ':') ++p;
+        if (p != end && !digits(2, zone_minute)) return false;
+        zone = sign * (zone_hour * 3600 + zone_minute * 60);
+      }
+    }
+    if (p != end) return false;
+
+    static const int month_days[] = {31,29,31,30,31,30,31,31,30,31,30,31};
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (month < 1 || month > 12 || day < 1 || day > month_days[month - 1] ||
+        (month == 2 && day == 29 && !leap) ||
+        hour > 23 || minute > 59 || second > 60) {
+      return false;
+    }
+    seconds = 86400.0 * static_cast<double>(days_from_civil(year, month, day))
+      + 3600 * hour + 60 * minute + second - zone + fraction;
+    return true;
+  }
+
+private:
+  // Character classes
+  enum {
+    DIGIT = 1,     // 0-9
+    SIGN = 2,      // + -
+    DOT = 4,       // .
+    EXP = 8,       // e E
+    LETTER = 16,   // other letters
+    DATE = 32,     // / :
+    SPACE = 64,    // space
+    ZONE = 128,    // T Z
+    OTHER = 256
+  };
+
+  // Inferred columns
+  std::vector<column> cols;
+
+  // Bit mask of types each column's values could still be
+  std::vector<unsigned> candidates;
+
+  // Number of rows sampled
+  size_t nsampled;
+
+  // Return the class of a character, using a table built on first use
+  static unsigned char_class(char c) {
+    static const std::vector<uint16_t> table = make_class_table();
+    return table[static_cast<unsigned char>(c)];
+  }
+
+  static std::vector<uint16_t> make_class_table() {
+    std::vector<uint16_t> table(256, OTHER);
+    for (int c='a'; c<='z'; ++c) table[static_cast<size_t>(c)] = LETTER;
+    for (int c='A'; c<='Z'; ++c) table[static_cast<size_t>(c)] = LETTER;
+    for (int c='0'; c<='9'; ++c) table[static_cast<size_t>(c)] = DIGIT;
+    table['+'] = table['-'] = SIGN;
+    table['.'] = DOT;
+    table['e'] = table['E'] = EXP;
+    table['/'] = table[':'] = DATE;
+    table[' '] = SPACE;
+    table['T'] = table['Z'] = ZONE;
+    return table;
+  }
+
+  // Return true if s is more than a sign, and doesn't start with a zero
+  // followed by another digit
+  static bool numeric_prefix(const std::string &s) {
+    size_t i = !s.empty() && (s[0] == '+' || s[0] == '-');
+    if (i == s.size()) return false;
+    return !(s[i] == '0' && i + 1 < s.size() &&
+             (char_class(s[i + 1]) & DIGIT));
+  }
+
+  // Return true if mask has no classes other than allowed
+  static bool only(unsigned mask, unsigned allowed) {
+    return !(mask & ~allowed);
+  }
+
+  // Return the bit mask of types a value that isn't null could be.  The
+  // classes of its characters rule out most types, and only the remaining
+  // types are parsed.
+  static unsigned possible_types(const std::string &s) {
+    unsigned mask = 0;
+    for (char c : s) mask |= char_class(c);
+
+    unsigned types = 1u << STRING;
+    bool b = false;
+    int64_t i = 0;
+    double f = 0;
+    // 'T' is classified as a time zone separator, as in "TRUE"
+    if (only(mask, LETTER | EXP | ZONE) && parse_bool(s, b)) {
+      types |= 1u << BOOL;
+    }
+    if (only(mask, DIGIT | SIGN) && parse_integer(s, i)) {
+      types |= 1u << INTEGER;
+    }
+    if (only(mask, DIGIT | SIGN | DOT | EXP) && parse_float(s, f)) {
+      types |= 1u << FLOAT;
+    }
+    if ((mask & (DATE | SIGN)) &&
+        only(mask, DIGIT | SIGN | DOT | DATE | SPACE | ZONE) &&
+        parse_timestamp(s, f)) {
+      types |= 1u << TIMESTAMP;
+    }
+    return types;
+  }
+
+  // Days from 1970-01-01 to a date in the proleptic Gregorian calendar
+  static int64_t days_from_civil(int year, int month, int day) {
+    int64_t y = year - (month <= 2);
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+  }
+
+  // Start with every column able to be any type
+  void init(const std::vector<std::string> &header) {
+    cols.clear();
+    for (auto &name : header) {
+      column c = {name, STRING, 0, 0};
+      cols.push_back(c);
+    }
+    candidates.assign(header.size(), (1u << (STRING + 1)) - 1);
+  }
+
+  // Add one sampled row
+  void add(const std::vector<std::string> &row) {
+    for (size_t i=0; i<cols.size() && i<row.size(); ++i) {
+      const std::string &s = row[i];
+      column &c = cols[i];
+      c.max_width = std::max(c.max_width, s.size());
+      if (is_null(s)) {
+        c.nulls += 1;
+      } else if (candidates[i] != 1u << STRING) {
+        candidates[i] &= possible_types(s);
+      }
+    }
+    nsampled += 1;
+
+    // A column with only nulls so far is a string
+    for (size_t i=0; i<cols.size(); ++i) {
+      cols[i].type = STRING;
+      if (cols[i].nulls == nsampled) continue;
+      for (unsigned t=BOOL; t<STRING; ++t) {
+        if (candidates[i] & (1u << t)) {
+          cols[i].type = static_cast<column_type>(t);
+          break;
+        }
+      }
+    }
+  }
+
+  // Sample nrows rows at random byte offsets
+  void sample_random(const std::string &filename, char delimiter,
+                     size_t nrows, uint64_t seed) {
+    csvsample sampler(filename, delimiter, true, seed);
+    std::vector<std::vector<std::string> > rows;
+    sampler.sample(nrows, rows);
+    for (auto &row : rows) add(row);
+  }
+};
+
+#endif
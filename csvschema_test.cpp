@@ -0,0 +1,217 @@
+/* csvschema_test.cpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ */
+
+#include "csvschema.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+using namespace std;
+
+
+void test_classify();
+void test_timestamp();
+void test_infer();
+void test_infer_bool_case();
+void test_infer_sample_size();
+void test_infer_random();
+void test_parse();
+void test_parse_mismatch();
+
+
+int main() {
+  test_classify();
+  test_timestamp();
+  test_infer();
+  test_infer_bool_case();
+  test_infer_sample_size();
+  test_infer_random();
+  test_parse();
+  test_parse_mismatch();
+  cout << "csvschema_test PASSED\n";
+  return 0;
+}
+
+
+void test_classify() {
+  // Test the type of single values
+  assert(csvschema::classify("true") == csvschema::BOOL);
+  assert(csvschema::classify("No") == csvschema::BOOL);
+  assert(csvschema::classify("True") == csvschema::BOOL);
+  assert(csvschema::classify("TRUE") == csvschema::BOOL);
+  assert(csvschema::classify("42") == csvschema::INTEGER);
+  assert(csvschema::classify("-7") == csvschema::INTEGER);
+  assert(csvschema::classify("0") == csvschema::INTEGER);
+  assert(csvschema::classify("3.25") == csvschema::FLOAT);
+  assert(csvschema::classify("-1e-3") == csvschema::FLOAT);
+  assert(csvschema::classify("99999999999999999999") == csvschema::FLOAT);
+  assert(csvschema::classify("2024-01-31") == csvschema::TIMESTAMP);
+  assert(csvschema::classify("2024-01-31T13:45:00Z") == csvschema::TIMESTAMP);
+  assert(csvschema::classify("horse") == csvschema::STRING);
+  assert(csvschema::classify("02134") == csvschema::STRING);
+  assert(csvschema::classify("nan") == csvschema::STRING);
+  assert(csvschema::classify("inf") == csvschema::STRING);
+  assert(csvschema::classify("0x1F") == csvschema::STRING);
+  assert(csvschema::classify("1.2.3") == csvschema::STRING);
+  assert(csvschema::classify("-") == csvschema::STRING);
+  assert(csvschema::classify("2024-02-30") == csvschema::STRING);
+  assert(csvschema::classify("2024-01-31 25:00") == csvschema::STRING);
+  assert(csvschema::is_null(""));
+  assert(csvschema::is_null("NULL"));
+  assert(csvschema::is_null("N/A"));
+  assert(!csvschema::is_null("0"));
+}
+
+
+void test_timestamp() {
+  // Test converting timestamps to seconds since 1970
+  double s = 0;
+  assert(csvschema::parse_timestamp("1970-01-01", s) && s == 0);
+  assert(csvschema::parse_timestamp("2000-03-01 00:00", s) && s == 951868800);
+  assert(csvschema::parse_timestamp("2024/02/29T12:30:15", s) &&
+         s == 1709209815);
+  assert(csvschema::parse_timestamp("2024-02-29T12:30:15.5Z", s) &&
+         s == 1709209815.5);
+  assert(csvschema::parse_timestamp("2024-02-29T14:30:15+02:00", s) &&
+         s == 1709209815);
+  assert(csvschema::parse_timestamp("2024-02-29T07:00:15-0530", s) &&
+         s == 1709209815);
+  assert(csvschema::parse_timestamp("1969-12-31T23:59:59", s) && s == -1);
+  assert(!csvschema::parse_timestamp("2023-02-29", s));
+  assert(!csvschema::parse_timestamp("2024-01-31T", s));
+  assert(!csvschema::parse_timestamp("2024-01-31T12:00:00.", s));
+  assert(!csvschema::parse_timestamp("2024-01/31", s));
+}
+
+
+const string input =
+  "id,price,active,created,zip,notes\n"
+  "1,9.99,true,2024-01-31,02134,\n"
+  "2,10,false,2024-02-01 08:00,10001,NULL\n"
+  "3,,yes,,94105,\"a long note, with a comma\"\n"
+  "4,12.5,no,2024-02-03T09:15:00Z,60601,short\n";
+
+
+void test_infer() {
+  // Test inferring types, null rates and widths
+  stringstream iss(input);
+  csvstream csvin(iss);
+  csvschema schema(csvin);
+  assert(schema.sample_size() == 4);
+
+  const vector<csvschema::column> &cols = schema.columns();
+  assert(cols.size() == 6);
+  assert(cols[0].name == "id" && cols[0].type == csvschema::INTEGER);
+  assert(cols[1].type == csvschema::FLOAT);
+  assert(cols[2].type == csvschema::BOOL);
+  assert(cols[3].type == csvschema::TIMESTAMP);
+  assert(cols[4].type == csvschema::STRING);
+  assert(cols[5].type == csvschema::STRING);
+  assert(schema.null_rate(1) == 0.25);
+  assert(schema.null_rate(5) == 0.5);
+  assert(cols[0].max_width == 1);
+  assert(cols[5].max_width == 25);
+
+  ostringstream oss;
+  schema.print(oss);
+  assert(oss.str().find("price") != string::npos);
+  assert(oss.str().find("timestamp") != string::npos);
+  assert(oss.str().find("25.0% null") != string::npos);
+}
+
+
+void test_infer_bool_case() {
+  // Test inferring a bool column whose values are in mixed case
+  stringstream iss("flag\nTrue\nFALSE\ntrue\nTRUE\nFalse\n");
+  csvstream csvin(iss);
+  csvschema schema(csvin);
+  assert(schema.columns()[0].type == csvschema::BOOL);
+}
+
+
+void test_infer_sample_size() {
+  // Test that only the first rows are sampled, and that a column with only
+  // nulls is a string
+  stringstream iss("a,b\n1,\n2,\nx,\n");
+  csvstream csvin(iss);
+  csvschema schema(csvin, 2);
+  assert(schema.sample_size() == 2);
+  assert(schema.columns()[0].type == csvschema::INTEGER);
+  assert(schema.columns()[1].type == csvschema::STRING);
+  assert(schema.null_rate(1) == 1);
+}
+
+
+void test_infer_random() {
+  // Test sampling rows at random offsets of a file, including multiline
+  // values that can be mistaken for rows
+  const string filename = "csvschema_test.csv";
+  {
+    ofstream fout(filename.c_str());
+    fout << "id,amount,comment\n";
+    for (int i=0; i<2000; ++i) {
+      fout << i << "," << i * 0.5 << ",\"line one\nline two\"\n";
+    }
+  }
+
+  csvschema first(filename, 100);
+  assert(first.sample_size() == 100);
+
+  csvschema sample(filename, 200, csvschema::RANDOM, ',', 1);
+  assert(sample.sample_size() == 200);
+  assert(sample.columns()[0].type == csvschema::INTEGER);
+  assert(sample.columns()[1].type == csvschema::FLOAT);
+  assert(sample.columns()[2].type == csvschema::STRING);
+  remove(filename.c_str());
+}
+
+
+void test_parse() {
+  // Test converting rows to typed values
+  stringstream iss(input);
+  csvstream csvin(iss);
+  csvschema schema(csvin);
+
+  stringstream iss2(input);
+  csvstream csvin2(iss2);
+  vector<string> row;
+  vector<csvschema::value> values;
+  csvin2 >> row;
+  schema.parse(row, values);
+  assert(values[0].i == 1);
+  assert(values[1].f == 9.99);
+  assert(values[2].b == true);
+  assert(values[3].f == 1706659200);
+  assert(values[4].s == "02134");
+  assert(values[5].null);
+
+  csvin2 >> row >> row;
+  schema.parse(row, values);
+  assert(values[1].null);
+  assert(values[3].null);
+  assert(!values[5].null);
+  assert(values[5].s == "a long note, with a comma");
+}
+
+
+void test_parse_mismatch() {
+  // Test error condition: a value that doesn't match its column's type
+  stringstream iss("a,b\n1,2\n");
+  csvstream csvin(iss);
+  csvschema schema(csvin);
+  vector<csvschema::value> values;
+  try {
+    schema.parse({"1", "two"}, values);
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()).find("column = b") != string::npos);
+  }
+}
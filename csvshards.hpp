@@ -0,0 +1,334 @@
+/* -*- mode: c++ -*- */
+#ifndef CSVSHARDS_HPP
+#define CSVSHARDS_HPP
+/* csvshards.hpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ *
+ * Read many CSV files with identical headers on a pool of threads.  Each
+ * thread has its own queue of work, and steals from other threads when its
+ * queue is empty.  Large files are split into ranges of rows so that one big
+ * file doesn't keep a single thread busy after the others are done.
+ */
+
+#include "csvstream.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+
+// csvshards interface
+class csvshards {
+public:
+  // Read the header of the first file.  Files larger than split_size bytes
+  // are split into ranges of about split_size bytes.  Throws
+  // csvstream_exception if there are no files or the first can't be read.
+  csvshards(const std::vector<std::string> &filenames,
+            char delimiter=',',
+            bool strict=true,
+            size_t nthreads=std::thread::hardware_concurrency(),
+            size_t split_size=64 * 1024 * 1024)
+    : filenames(filenames),
+      delimiter(delimiter),
+      strict(strict),
+      nthreads(nthreads ? nthreads : 1),
+      split_size(split_size ? split_size : 1) {
+    if (filenames.empty()) {
+      throw csvstream_exception("No files to read");
+    }
+    csvstream csvin(filenames[0], delimiter, strict);
+    header = csvin.getheader();
+  }
+
+  // Return header of the first file
+  std::vector<std::string> getheader() const {
+    return header;
+  }
+
+  // A whole file, or a range of rows in a file
+  struct task {
+    size_t file;
+    std::streamoff offset;
+    size_t line_no;
+    size_t nrows;
+    bool range;
+  };
+
+  // Scan filenames[file] for row boundaries and return ranges of about
+  // split_size bytes.  The scan follows the same quoting, escaping and line
+  // ending rules as csvstream, without copying any values.  Return one range
+  // or less for a small file.  Read a range with csvstream::seek().
+  std::vector<task> split(size_t file) const {
+    std::vector<task> ranges;
+    split(file, [&ranges](const task &r) { ranges.push_back(r); });
+    return ranges;
+  }
+
+  // Scan filenames[file] for row boundaries, calling add(range) for each
+  // range as soon as its end is found.  Return the number of ranges.  The
+  // scan is serial, because the quote state at an arbitrary offset can't be
+  // known without reading from the start of the file, but the rows of each
+  // range can be read while the scan continues.
+  size_t split(size_t file, const std::function<void(const task &)> &add) const {
+    const std::string &filename = filenames[file];
+    std::ifstream fin(filename.c_str(), std::ios::binary);
+    if (!fin.is_open()) {
+      throw csvstream_exception("Error opening file: " + filename);
+    }
+    fin.seekg(0, std::ios::end);
+    std::streamoff size = fin.tellg();
+    fin.seekg(0);
+    size_t nranges = 0;
+    if (size <= static_cast<std::streamoff>(split_size)) return nranges;
+
+    std::vector<char> buffer(1 << 20);
+    enum State {START, QUOTED, QUOTED_ESCAPED, UNQUOTED, UNQUOTED_ESCAPED, END};
+    State state = START;
+    std::streamoff pos = 0;
+    std::streamoff range_start = -1;
+    size_t rows = 0;
+    size_t range_rows = 0;
+    bool in_header = true;
+
+    // Called at the start of each row, after the header
+    auto row_start = [&](std::streamoff offset) {
+      if (range_start >= 0 &&
+          offset - range_start < static_cast<std::streamoff>(split_size)) {
+        return;
+      }
+      if (range_start >= 0) {
+        task r = {file, range_start, rows - range_rows, range_rows, true};
+        add(r);
+        nranges += 1;
+      }
+      range_start = offset;
+      range_rows = 0;
+    };
+
+    while (fin) {
+      fin.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+      std::streamsize n = fin.gcount();
+      for (std::streamsize i=0; i<n; ++i, ++pos) {
+        char c = buffer[static_cast<size_t>(i)];
+        if (state == END) {
+          // A line ending is followed by at most one more '\n'
+          state = START;
+          if (c == '\n') continue;
+        }
+        if (state == START) {
+          if (!in_header) {
+            row_start(pos);
+            rows += 1;
+            range_rows += 1;
+          }
+          in_header = false;
+          state = UNQUOTED;
+        }
+        switch (state) {
+        case UNQUOTED:
+          if (c == '"') state = QUOTED;
+          else if (c == '\\') state = UNQUOTED_ESCAPED;
+          else if (c == '\n' || c == '\r') state = END;
+          break;
+        case UNQUOTED_ESCAPED:
+          state = UNQUOTED;
+          break;
+        case QUOTED:
+          if (c == '"') state = UNQUOTED;
+          else if (c == '\\') state = QUOTED_ESCAPED;
+          break;
+        case QUOTED_ESCAPED:
+          state = QUOTED;
+          break;
+        default:
+          break;
+        }
+      }
+    }
+
+    if (range_start >= 0) {
+      task r = {file, range_start, rows - range_rows, range_rows, true};
+      add(r);
+      nranges += 1;
+    }
+    return nranges;
+  }
+
+  // Read every row of every file, calling consumer(worker, row) for each row
+  // from worker threads numbered 0 to nthreads-1.  Rows are delivered in file
+  // order within a range, but ranges are processed concurrently.  Throws the
+  // first exception from any worker, for example a csvstream_exception naming
+  // the file with a header that doesn't match the first file.
+  template <typename Row>
+  void process(const std::function<void(size_t worker, Row &row)> &consumer) {
+    // Give each worker an equal share of the files
+    queues = std::vector<queue>(nthreads);
+    pending = filenames.size();
+    failed = false;
+    generation = 0;
+    error = nullptr;
+    for (size_t i=0; i<filenames.size(); ++i) {
+      task t = {i, 0, 0, 0, false};
+      queues[i % nthreads].tasks.push_back(t);
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t w=1; w<nthreads; ++w) {
+      threads.emplace_back([this, w, &consumer]() { work(w, consumer); });
+    }
+    work(0, consumer);
+    for (auto &t : threads) t.join();
+
+    if (error) std::rethrow_exception(error);
+  }
+
+private:
+  // One worker's tasks.  The owner takes from the back, thieves from the
+  // front.
+  struct queue {
+    std::mutex mutex;
+    std::deque<task> tasks;
+  };
+
+  // Input files
+  std::vector<std::string> filenames;
+
+  // Delimiter between columns
+  char delimiter;
+
+  // Strictly enforce the number of values in each row
+  bool strict;
+
+  // Number of worker threads
+  size_t nthreads;
+
+  // Approximate size of a range of a large file, in bytes
+  size_t split_size;
+
+  // Header of the first file
+  std::vector<std::string> header;
+
+  // Work queues, one per worker
+  std::vector<queue> queues;
+
+  // Number of tasks not yet finished
+  std::atomic<size_t> pending;
+
+  // Set when a worker fails, so the others stop early
+  std::atomic<bool> failed;
+
+  // Idle workers wait for new tasks, the last task to finish, or a failure.
+  // generation counts those events, so a worker that found no task doesn't
+  // miss one that happens before it starts waiting.
+  std::mutex wait_mutex;
+  std::condition_variable wait_cv;
+  size_t generation;
+
+  // First exception from any worker
+  std::exception_ptr error;
+  std::mutex error_mutex;
+
+  // Disable copying
+  csvshards(const csvshards &);
+  csvshards & operator= (const csvshards &);
+
+  // Take a task from our own queue, or steal one from another worker
+  bool get_task(size_t worker, task &t) {
+    for (size_t i=0; i<nthreads; ++i) {
+      queue &q = queues[(worker + i) % nthreads];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (q.tasks.empty()) continue;
+      if (i == 0) {
+        t = q.tasks.back();
+        q.tasks.pop_back();
+      } else {
+        t = q.tasks.front();
+        q.tasks.pop_front();
+      }
+      return true;
+    }
+    return false;
+  }
+
+  // Wake up idle workers
+  void notify() {
+    {
+      std::lock_guard<std::mutex> lock(wait_mutex);
+      generation += 1;
+    }
+    wait_cv.notify_all();
+  }
+
+  // Worker thread loop.  Sleep while there's no task to take, until a busy
+  // worker adds ranges or every task is finished.
+  template <typename Row>
+  void work(size_t worker,
+            const std::function<void(size_t, Row &)> &consumer) {
+    task t;
+    while (pending > 0 && !failed) {
+      size_t seen;
+      {
+        std::lock_guard<std::mutex> lock(wait_mutex);
+        seen = generation;
+      }
+      if (!get_task(worker, t)) {
+        std::unique_lock<std::mutex> lock(wait_mutex);
+        wait_cv.wait(lock, [this, seen]() { return generation != seen; });
+        continue;
+      }
+      try {
+        run_task(worker, t, consumer);
+      } catch(...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) error = std::current_exception();
+        failed = true;
+      }
+      if (--pending == 0 || failed) notify();
+    }
+  }
+
+  // Read the rows of one task.  A large file is split into ranges instead,
+  // which are added to our queue where other workers can steal them while
+  // the rest of the file is scanned.
+  template <typename Row>
+  void run_task(size_t worker, const task &t,
+                const std::function<void(size_t, Row &)> &consumer) {
+    const std::string &filename = filenames[t.file];
+    csvstream csvin(filename, delimiter, strict);
+    if (csvin.getheader() != header) {
+      throw csvstream_exception("Header does not match " + filenames[0] +
+                                ". " + filename);
+    }
+
+    if (!t.range) {
+      queue &q = queues[worker];
+      size_t nranges = split(t.file, [this, &q](const task &r) {
+        {
+          std::lock_guard<std::mutex> lock(q.mutex);
+          pending += 1;
+          q.tasks.push_back(r);
+        }
+        notify();
+      });
+      if (nranges) return;
+    }
+
+    Row row;
+    if (t.range) csvin.seek(t.offset, t.line_no);
+    for (size_t n=0; !t.range || n<t.nrows; ++n) {
+      if (failed || !(csvin >> row)) break;
+      consumer(worker, row);
+    }
+  }
+};
+
+#endif
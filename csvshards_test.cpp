@@ -0,0 +1,144 @@
+/* csvshards_test.cpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ */
+
+#include "csvshards.hpp"
+#include "csvtest.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+using namespace std;
+
+
+void test_shards();
+void test_shards_split();
+void test_shards_error_line();
+void test_shards_header_mismatch();
+
+
+int main() {
+  test_shards();
+  test_shards_split();
+  test_shards_error_line();
+  test_shards_header_mismatch();
+  cout << "csvshards_test PASSED\n";
+  return 0;
+}
+
+
+// Read all shards and return every row, sorted
+vector<vector<string>> read_all(csvshards &shards, size_t nthreads) {
+  vector<vector<vector<string>>> per_worker(nthreads);
+  shards.process<vector<string>>([&](size_t worker, vector<string> &row) {
+    per_worker.at(worker).push_back(row);
+  });
+  vector<vector<string>> rows;
+  for (auto &w : per_worker) rows.insert(rows.end(), w.begin(), w.end());
+  sort(rows.begin(), rows.end());
+  return rows;
+}
+
+
+void test_shards() {
+  // Test reading several files on several threads
+
+  vector<string> filenames;
+  vector<vector<string>> output_correct;
+  for (int i=0; i<10; ++i) {
+    string filename = "csvshards_test_" + to_string(i) + ".csv";
+    ostringstream oss;
+    oss << "shard,n\n";
+    for (int n=0; n<i * 10; ++n) {
+      oss << i << "," << n << "\n";
+      output_correct.push_back({to_string(i), to_string(n)});
+    }
+    write_file(filename, oss.str());
+    filenames.push_back(filename);
+  }
+  sort(output_correct.begin(), output_correct.end());
+
+  csvshards shards(filenames, ',', true, 4);
+  assert(shards.getheader() == vector<string>({"shard", "n"}));
+  vector<vector<string>> output_observed = read_all(shards, 4);
+  assert(output_observed == output_correct);
+
+  for (auto &f : filenames) remove(f.c_str());
+}
+
+
+void test_shards_split() {
+  // Test splitting a large file into ranges.  Quoted values contain line
+  // endings, escaped quotes and blank lines, which must not be mistaken for
+  // row boundaries.
+
+  ostringstream oss;
+  vector<vector<string>> output_correct;
+  oss << "id,text\r\n";
+  for (int i=0; i<500; ++i) {
+    oss << i << ",\"line one\r\n\r\nline \\\"" << i << "\\\" two\"\r\n";
+    output_correct.push_back(
+      {to_string(i), "line one\r\n\r\nline \\\"" + to_string(i) + "\\\" two"});
+  }
+  write_file("csvshards_test_big.csv", oss.str());
+  sort(output_correct.begin(), output_correct.end());
+
+  vector<string> filenames = {"csvshards_test_big.csv"};
+  for (size_t split_size : {1u, 100u, 1000u, 1000000u}) {
+    csvshards shards(filenames, ',', true, 3, split_size);
+    vector<vector<string>> output_observed = read_all(shards, 3);
+    assert(output_observed == output_correct);
+  }
+
+  remove("csvshards_test_big.csv");
+}
+
+
+void test_shards_error_line() {
+  // Test error condition: a row with too few values in the middle of a split
+  // file.  The error message names the file and the row.
+
+  ostringstream oss;
+  oss << "a,b\n";
+  for (int i=1; i<=100; ++i) {
+    oss << i << (i == 73 ? "\n" : ",x\n");
+  }
+  write_file("csvshards_test_bad.csv", oss.str());
+
+  csvshards shards({"csvshards_test_bad.csv"}, ',', true, 2, 50);
+  try {
+    read_all(shards, 2);
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()).find("csvshards_test_bad.csv:L73 ") !=
+           string::npos);
+  }
+
+  remove("csvshards_test_bad.csv");
+}
+
+
+void test_shards_header_mismatch() {
+  // Test error condition: a file with a different header
+
+  write_file("csvshards_test_a.csv", "name,animal\nOscar,cat\n");
+  write_file("csvshards_test_b.csv", "name,species\nFergie,horse\n");
+
+  csvshards shards({"csvshards_test_a.csv", "csvshards_test_b.csv"}, ',', true, 2);
+  try {
+    read_all(shards, 2);
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()).find("csvshards_test_b.csv") != string::npos);
+  }
+
+  remove("csvshards_test_a.csv");
+  remove("csvshards_test_b.csv");
+}
@@ -0,0 +1,331 @@
+/* -*- mode: c++ -*- */
+#ifndef CSVSHARED_HPP
+#define CSVSHARED_HPP
+/* csvshared.hpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ *
+ * Share one csvstream between many consumer threads.  A reader thread parses
+ * ahead into batches of rows, and consumers take whole batches from a
+ * lock-free queue, so there's one synchronization per batch instead of one
+ * per row.  Batches are swapped rather than copied, and their memory is
+ * reused for later batches.
+ */
+
+#include "csvstream.hpp"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <exception>
+#include <cstddef>
+#include <cstdint>
+
+
+// Bounded multi-producer multi-consumer queue, after Dmitry Vyukov's design.
+// Each cell has a sequence number that says whether it's ready to be written
+// or read in the current lap around the ring, so producers and consumers only
+// contend on their own position counter.  Values are swapped in and out, so
+// the caller gets back the previous contents of the cell.
+template <typename T>
+class csvmpmc_queue {
+public:
+  // Capacity is rounded up to a power of 2
+  explicit csvmpmc_queue(size_t capacity) {
+    size_t n = 2;
+    while (n < capacity) n *= 2;
+    mask = n - 1;
+    cells.reset(new cell[n]);
+    for (size_t i=0; i<n; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+    push_pos.store(0, std::memory_order_relaxed);
+    pop_pos.store(0, std::memory_order_relaxed);
+  }
+
+  // Swap value into the queue.  Return false if the queue is full.
+  bool try_push(T &value) {
+    cell *c = nullptr;
+    size_t pos = push_pos.load(std::memory_order_relaxed);
+    while (true) {
+      c = &cells[pos & mask];
+      size_t seq = c->sequence.load(std::memory_order_acquire);
+      std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq - pos);
+      if (diff == 0) {
+        if (push_pos.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = push_pos.load(std::memory_order_relaxed);
+      }
+    }
+    using std::swap;
+    swap(c->value, value);
+    c->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Swap the oldest value out of the queue.  Return false if the queue is
+  // empty.
+  bool try_pop(T &value) {
+    cell *c = nullptr;
+    size_t pos = pop_pos.load(std::memory_order_relaxed);
+    while (true) {
+      c = &cells[pos & mask];
+      size_t seq = c->sequence.load(std::memory_order_acquire);
+      std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+      if (diff == 0) {
+        if (pop_pos.compare_exchange_weak(pos, pos + 1,
+                                          std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = pop_pos.load(std::memory_order_relaxed);
+      }
+    }
+    using std::swap;
+    swap(c->value, value);
+    c->sequence.store(pos + mask + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Return the approximate number of values in the queue
+  size_t size() const {
+    size_t push = push_pos.load(std::memory_order_relaxed);
+    size_t pop = pop_pos.load(std::memory_order_relaxed);
+    return push > pop ? push - pop : 0;
+  }
+
+  // Return the number of values the queue can hold
+  size_t capacity() const {
+    return mask + 1;
+  }
+
+private:
+  struct cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  std::unique_ptr<cell[]> cells;
+  size_t mask;
+
+  // Producer and consumer positions, on separate cache lines
+  alignas(64) std::atomic<size_t> push_pos;
+  alignas(64) std::atomic<size_t> pop_pos;
+
+  // Disable copying
+  csvmpmc_queue(const csvmpmc_queue &);
+  csvmpmc_queue & operator= (const csvmpmc_queue &);
+};
+
+
+// csvshared interface
+class csvshared {
+public:
+  // A batch of rows of values, in column order
+  typedef std::vector<std::vector<std::string> > batch;
+
+  // Statistics for sizing the number of consumers.  Wait times are totals
+  // across threads, in seconds.  Queue depth is sampled each time a batch is
+  // added.
+  struct stats {
+    size_t batches;
+    size_t rows;
+    double mean_depth;
+    size_t max_depth;
+    double reader_wait;
+    double consumer_wait;
+  };
+
+  // Start a reader thread that reads every remaining row of in, in batches
+  // of batch_size rows.  At most queue_size batches are parsed ahead.  in
+  // must not be used by anything else until the csvshared is destroyed.
+  csvshared(csvstream &in, size_t batch_size=4096, size_t queue_size=16)
+    : in(in),
+      batch_size(batch_size ? batch_size : 1),
+      queue(queue_size),
+      done(false),
+      stopping(false),
+      nbatches(0),
+      nrows(0),
+      depth_total(0),
+      depth_max(0),
+      reader_wait_ns(0),
+      consumer_wait_ns(0) {
+    reader = std::thread([this]() { read_loop(); });
+  }
+
+  // Stop the reader thread, even if rows remain
+  ~csvshared() {
+    stopping.store(true);
+    reader.join();
+  }
+
+  // Return header of the input
+  std::vector<std::string> getheader() const {
+    return in.getheader();
+  }
+
+  // Take the next batch of rows.  Safe to call from many threads at once.
+  // The previous contents of rows are reused for a later batch.  Return false
+  // after the last batch.  Throws the reader's exception, for example a
+  // csvstream_exception for a row that doesn't match the header, once the
+  // batches before the error have been taken.
+  bool read(batch &rows) {
+    if (queue.try_pop(rows)) return true;
+
+    auto start = clock::now();
+    bool ok = true;
+    for (unsigned n=0; !queue.try_pop(rows); ++n) {
+      // The reader may add its last batch just before it's done
+      if (done.load(std::memory_order_acquire) && !queue.try_pop(rows)) {
+        ok = false;
+        break;
+      }
+      backoff(n);
+    }
+    consumer_wait_ns += elapsed_ns(start);
+    if (!ok) {
+      rows.clear();
+      if (error) std::rethrow_exception(error);
+    }
+    return ok;
+  }
+
+  // Return the number of batches waiting to be taken
+  size_t depth() const {
+    return queue.size();
+  }
+
+  // Return statistics so far
+  stats getstats() const {
+    stats s;
+    s.batches = nbatches.load();
+    s.rows = nrows.load();
+    s.mean_depth = s.batches ? static_cast<double>(depth_total.load()) /
+      static_cast<double>(s.batches) : 0;
+    s.max_depth = depth_max.load();
+    s.reader_wait = static_cast<double>(reader_wait_ns.load()) / 1e9;
+    s.consumer_wait = static_cast<double>(consumer_wait_ns.load()) / 1e9;
+    return s;
+  }
+
+  // Print statistics so far.  A queue that's usually empty, with a long
+  // consumer wait, means the reader is the bottleneck and more consumers
+  // won't help.  A queue that's usually full, with a long reader wait, means
+  // there's room for more consumers.
+  void print_stats(std::ostream &os) const {
+    stats s = getstats();
+    os << std::fixed << std::setprecision(3)
+       << "batches: " << s.batches << "\n"
+       << "rows: " << s.rows << "\n"
+       << "queue depth: " << s.mean_depth << " mean, " << s.max_depth
+       << " max, " << queue.capacity() << " capacity\n"
+       << "reader wait: " << s.reader_wait << "s\n"
+       << "consumer wait: " << s.consumer_wait << "s\n";
+  }
+
+private:
+  typedef std::chrono::steady_clock clock;
+
+  // Input, only used by the reader thread
+  csvstream &in;
+
+  // Rows per batch
+  size_t batch_size;
+
+  // Parsed batches
+  csvmpmc_queue<batch> queue;
+
+  // Set by the reader thread after the last batch is added
+  std::atomic<bool> done;
+
+  // Set by the destructor to stop the reader thread
+  std::atomic<bool> stopping;
+
+  // Reader's exception, written before done is set
+  std::exception_ptr error;
+
+  // Statistics
+  std::atomic<size_t> nbatches;
+  std::atomic<size_t> nrows;
+  std::atomic<size_t> depth_total;
+  std::atomic<size_t> depth_max;
+  std::atomic<uint64_t> reader_wait_ns;
+  std::atomic<uint64_t> consumer_wait_ns;
+
+  // Reader thread
+  std::thread reader;
+
+  // Disable copying
+  csvshared(const csvshared &);
+  csvshared & operator= (const csvshared &);
+
+  static uint64_t elapsed_ns(clock::time_point start) {
+    return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        clock::now() - start).count());
+  }
+
+  // Wait a little longer each time the queue isn't ready.  Yield at first,
+  // then sleep, so waiting threads don't take a core from the reader.
+  static void backoff(unsigned n) {
+    if (n < 16) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+
+  // Reader thread: parse batches and add them to the queue
+  void read_loop() {
+    try {
+      batch rows;
+      while (!stopping.load(std::memory_order_relaxed)) {
+        // Reuse the rows of a batch returned by a consumer
+        rows.resize(batch_size);
+        size_t n = 0;
+        while (n < batch_size && in >> rows[n]) ++n;
+        rows.resize(n);
+        if (n && !push(rows)) break;
+        if (n < batch_size) break;
+      }
+    } catch(...) {
+      error = std::current_exception();
+    }
+    done.store(true, std::memory_order_release);
+  }
+
+  // Add a batch to the queue, waiting while it's full.  Return false if the
+  // destructor is stopping the reader.
+  bool push(batch &rows) {
+    size_t n = rows.size();
+    if (!queue.try_push(rows)) {
+      auto start = clock::now();
+      for (unsigned i=0; !queue.try_push(rows); ++i) {
+        if (stopping.load(std::memory_order_relaxed)) return false;
+        backoff(i);
+      }
+      reader_wait_ns += elapsed_ns(start);
+    }
+    size_t depth = queue.size();
+    nbatches += 1;
+    nrows += n;
+    depth_total += depth;
+    if (depth > depth_max.load(std::memory_order_relaxed)) depth_max = depth;
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,184 @@
+/* csvshared_test.cpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ */
+
+#include "csvshared.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+using namespace std;
+
+
+void test_mpmc_queue();
+void test_shared();
+void test_shared_threads();
+void test_shared_error();
+void test_shared_stop();
+
+
+int main() {
+  test_mpmc_queue();
+  test_shared();
+  test_shared_threads();
+  test_shared_error();
+  test_shared_stop();
+  cout << "csvshared_test PASSED\n";
+  return 0;
+}
+
+
+// Return a CSV file with nrows rows numbered from 0
+string numbered_rows(size_t nrows) {
+  string s = "id,name\n";
+  for (size_t i=0; i<nrows; ++i) {
+    s += to_string(i) + ",\"row " + to_string(i) + "\"\n";
+  }
+  return s;
+}
+
+
+void test_mpmc_queue() {
+  // Test that values come out in order, that a full queue refuses values,
+  // and that values are swapped, not copied
+  csvmpmc_queue<string> queue(3);
+  assert(queue.capacity() == 4);
+  string value;
+  vector<bool> output_observed;
+  output_observed.push_back(queue.try_pop(value));
+  for (size_t i=0; i<4; ++i) {
+    value = to_string(i);
+    output_observed.push_back(queue.try_push(value));
+    assert(value.empty());
+  }
+  value = "4";
+  output_observed.push_back(queue.try_push(value));
+  assert(output_observed ==
+         vector<bool>({false, true, true, true, true, false}));
+  assert(queue.size() == 4);
+
+  // Wrap around the ring
+  output_observed.clear();
+  for (size_t i=0; i<10; ++i) {
+    output_observed.push_back(queue.try_pop(value));
+    assert(value == to_string(i));
+    value = to_string(i + 4);
+    output_observed.push_back(queue.try_push(value));
+  }
+  assert(output_observed == vector<bool>(20, true));
+  assert(queue.size() == 4);
+}
+
+
+void test_shared() {
+  // Test that one consumer gets every row in order, in full batches
+  istringstream iss(numbered_rows(10));
+  csvstream csvin(iss);
+  csvshared shared(csvin, 4, 2);
+  assert(shared.getheader() == vector<string>({"id", "name"}));
+
+  csvshared::batch rows;
+  vector<size_t> sizes;
+  size_t next = 0;
+  while (shared.read(rows)) {
+    sizes.push_back(rows.size());
+    for (auto &row : rows) {
+      assert(row == vector<string>({to_string(next), "row " + to_string(next)}));
+      next += 1;
+    }
+  }
+  assert(next == 10);
+  assert(sizes == vector<size_t>({4, 4, 2}));
+  assert(rows.empty());
+
+  // Reading again after the end finds nothing
+  while (shared.read(rows)) sizes.push_back(rows.size());
+  assert(sizes.size() == 3);
+
+  csvshared::stats s = shared.getstats();
+  assert(s.batches == 3);
+  assert(s.rows == 10);
+  assert(s.max_depth <= 2);
+}
+
+
+void test_shared_threads() {
+  // Test that every row is delivered exactly once to many consumers
+  const size_t nrows = 100000;
+  const size_t nthreads = 4;
+  istringstream iss(numbered_rows(nrows));
+  csvstream csvin(iss);
+  csvshared shared(csvin, 1000, 4);
+
+  vector<vector<size_t>> ids(nthreads);
+  vector<thread> threads;
+  for (size_t t=0; t<nthreads; ++t) {
+    threads.emplace_back([&shared, &ids, t]() {
+      csvshared::batch rows;
+      while (shared.read(rows)) {
+        for (auto &row : rows) ids[t].push_back(stoul(row[0]));
+      }
+    });
+  }
+  for (auto &t : threads) t.join();
+
+  vector<size_t> all;
+  for (auto &v : ids) all.insert(all.end(), v.begin(), v.end());
+  sort(all.begin(), all.end());
+  assert(all.size() == nrows);
+  for (size_t i=0; i<nrows; ++i) assert(all[i] == i);
+
+  csvshared::stats s = shared.getstats();
+  assert(s.batches == nrows / 1000);
+  assert(s.rows == nrows);
+  assert(s.max_depth <= 4);
+  assert(s.consumer_wait >= 0);
+  ostringstream oss;
+  shared.print_stats(oss);
+  assert(oss.str().find("batches: 100\n") != string::npos);
+}
+
+
+void test_shared_error() {
+  // Test error condition: a row with too many values.  Consumers get the rows
+  // before it, then the exception.
+  istringstream iss("a,b\n1,2\n3,4\n5,6,7\n8,9\n");
+  csvstream csvin(iss);
+  csvshared shared(csvin, 1);
+  csvshared::batch rows;
+  size_t nrows = 0;
+  try {
+    while (shared.read(rows)) nrows += rows.size();
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()).find("Number of items in row does not match "
+                                 "header. [no filename]:L3 ") != string::npos);
+  }
+  assert(nrows == 2);
+
+  // Every later read throws too
+  try {
+    shared.read(rows);
+    assert(0);
+  } catch(const csvstream_exception &e) {}
+}
+
+
+void test_shared_stop() {
+  // Test destroying a csvshared whose reader is waiting on a full queue
+  istringstream iss(numbered_rows(1000));
+  csvstream csvin(iss);
+  {
+    csvshared shared(csvin, 10, 2);
+    csvshared::batch rows;
+    shared.read(rows);
+    assert(rows.size() == 10);
+  }
+}
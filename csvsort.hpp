@@ -0,0 +1,349 @@
+/* -*- mode: c++ -*- */
+#ifndef CSVSORT_HPP
+#define CSVSORT_HPP
+/* csvsort.hpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ *
+ * Sort a CSV file by a key column using bounded memory.  Rows are read into
+ * runs that fit in a memory budget.  Each run is sorted and written to a
+ * temporary file, then the runs are merged.  The sort is stable.
+ */
+
+#include "csvstream.hpp"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <queue>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+
+
+// csvsort interface
+class csvsort {
+public:
+  // Compare keys as strings, or as numbers.  With NUMERIC, keys that aren't
+  // numbers sort after all numbers, as strings.
+  enum key_type {LEXICAL, NUMERIC};
+
+  // Time spent in each phase, in seconds
+  struct stats {
+    double read;
+    double sort;
+    double spill;
+    double merge;
+    size_t rows;
+    size_t runs;
+  };
+
+  // Configure a sort by the column named key.  memory_budget is the
+  // approximate number of bytes of rows held in memory at once.  At least one
+  // row is held, even with a smaller budget, such as 0.  Temporary
+  // files are created in temp_dir.  Each run is sorted with nthreads threads.
+  csvsort(const std::string &key,
+          key_type type=LEXICAL,
+          size_t memory_budget=256 * 1024 * 1024,
+          const std::string &temp_dir=default_temp_dir(),
+          size_t nthreads=1)
+    : key(key),
+      type(type),
+      memory_budget(memory_budget),
+      temp_dir(temp_dir),
+      nthreads(nthreads ? nthreads : 1),
+      key_col(0),
+      times() {}
+
+  // Destructor removes any leftover temporary files
+  ~csvsort() {
+    remove_temp_files();
+  }
+
+  // Sort every remaining row of in and write them to out.  out should have
+  // the same header as in.  Throws csvstream_exception if the key column
+  // doesn't exist or a temporary file can't be created.
+  void sort(csvstream &in, csvwriter &out) {
+    times = stats();
+    header = in.getheader();
+    key_col = find_key();
+    std::vector<record> run;
+    bool more = true;
+
+    // Read, sort and spill runs
+    while (more) {
+      more = read_run(in, run);
+      sort_run(run);
+      if (!more && temp_files.empty()) {
+        // Everything fit in memory, so write directly to the output
+        auto start = clock::now();
+        for (auto &r : run) out << r.fields;
+        times.merge += elapsed(start);
+        return;
+      }
+      if (!run.empty()) spill_run(run);
+    }
+
+    // Merge runs, in several passes if there are too many to open at once
+    auto start = clock::now();
+    const std::ptrdiff_t fanin = static_cast<std::ptrdiff_t>(max_fanin);
+    while (temp_files.size() > max_fanin) {
+      // The merged run takes the place of its inputs, keeping runs in order
+      std::vector<std::string> inputs(temp_files.begin(),
+                                      temp_files.begin() + fanin);
+      std::string merged = make_temp_file();
+      temp_files.pop_back();
+      temp_files.insert(temp_files.begin() + fanin, merged);
+      {
+        csvwriter tmp(merged, header);
+        merge(inputs, tmp);
+      }
+      remove_files(inputs);
+      temp_files.erase(temp_files.begin(), temp_files.begin() + fanin);
+    }
+    merge(temp_files, out);
+    remove_temp_files();
+    times.merge += elapsed(start);
+  }
+
+  // Sort a file into another file
+  void sort(const std::string &infile,
+            const std::string &outfile,
+            char delimiter=',') {
+    csvstream in(infile, delimiter);
+    csvwriter out(outfile, in.getheader(), delimiter);
+    sort(in, out);
+  }
+
+  // Return time spent in each phase of the last sort
+  const stats & getstats() const {
+    return times;
+  }
+
+  // Print time spent in each phase of the last sort
+  void print_stats(std::ostream &os) const {
+    os << std::fixed << std::setprecision(3)
+       << "rows: " << times.rows << "\n"
+       << "runs: " << times.runs << "\n"
+       << "read: " << times.read << "s\n"
+       << "sort: " << times.sort << "s\n"
+       << "spill: " << times.spill << "s\n"
+       << "merge: " << times.merge << "s\n";
+  }
+
+  // Return $TMPDIR, or /tmp
+  static std::string default_temp_dir() {
+    const char *dir = std::getenv("TMPDIR");
+    return dir && *dir ? dir : "/tmp";
+  }
+
+private:
+  typedef std::chrono::steady_clock clock;
+
+  // One row, with its key parsed once for numeric comparisons
+  struct record {
+    std::vector<std::string> fields;
+    double number;
+    bool numeric;
+  };
+
+  // Maximum number of runs merged at once, limited by open files
+  static const size_t max_fanin = 64;
+
+  // Key column name
+  std::string key;
+
+  // Key comparison
+  key_type type;
+
+  // Approximate memory for one run, in bytes
+  size_t memory_budget;
+
+  // Directory for temporary files
+  std::string temp_dir;
+
+  // Number of threads for sorting a run
+  size_t nthreads;
+
+  // Header of the input
+  std::vector<std::string> header;
+
+  // Index of the key column
+  size_t key_col;
+
+  // Temporary files holding sorted runs, in input order
+  std::vector<std::string> temp_files;
+
+  // Statistics for the last sort
+  stats times;
+
+  // Disable copying
+  csvsort(const csvsort &);
+  csvsort & operator= (const csvsort &);
+
+  static double elapsed(clock::time_point start) {
+    return std::chrono::duration<double>(clock::now() - start).count();
+  }
+
+  // Return the index of the key column
+  size_t find_key() const {
+    for (size_t i=0; i<header.size(); ++i) {
+      if (header[i] == key) return i;
+    }
+    throw csvstream_exception("No such column: " + key);
+  }
+
+  // Parse the key of a record for numeric comparisons
+  void parse_key(record &r) const {
+    r.numeric = false;
+    r.number = 0;
+    if (type != NUMERIC) return;
+    const std::string &k = r.fields[key_col];
+    if (k.empty()) return;
+    char *end = nullptr;
+    r.number = std::strtod(k.c_str(), &end);
+    // NaN isn't ordered, so sort it as a string
+    r.numeric = end == k.c_str() + k.size() && r.number == r.number;
+  }
+
+  // Return true if the key of a sorts before the key of b
+  bool less(const record &a, const record &b) const {
+    if (type == NUMERIC) {
+      if (a.numeric && b.numeric) return a.number < b.number;
+      if (a.numeric != b.numeric) return a.numeric;
+    }
+    return a.fields[key_col] < b.fields[key_col];
+  }
+
+  // Read rows until the memory budget is used, and at least one row.  Return
+  // false at end of input.
+  bool read_run(csvstream &in, std::vector<record> &run) {
+    auto start = clock::now();
+    run.clear();
+    size_t bytes = 0;
+    record r;
+    bool more = true;
+    while (run.empty() || bytes < memory_budget) {
+      if (!(in >> r.fields)) {
+        more = false;
+        break;
+      }
+      parse_key(r);
+      bytes += sizeof(record);
+      for (auto &f : r.fields) bytes += sizeof(std::string) + f.size();
+      run.push_back(std::move(r));
+    }
+    times.rows += run.size();
+    times.read += elapsed(start);
+    return more;
+  }
+
+  // Sort a run.  With several threads, sort equal slices in parallel, then
+  // merge adjacent slices.
+  void sort_run(std::vector<record> &run) {
+    auto start = clock::now();
+    auto cmp = [this](const record &a, const record &b) {
+      return less(a, b);
+    };
+    size_t nslices = std::min(nthreads, run.size() / 1024 + 1);
+    std::vector<size_t> bounds;
+    for (size_t i=0; i<=nslices; ++i) {
+      bounds.push_back(run.size() * i / nslices);
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i=1; i<nslices; ++i) {
+      threads.emplace_back([&run, &bounds, &cmp, i]() {
+        std::stable_sort(run.begin() + static_cast<std::ptrdiff_t>(bounds[i]),
+                         run.begin() + static_cast<std::ptrdiff_t>(bounds[i + 1]), cmp);
+      });
+    }
+    std::stable_sort(run.begin(), run.begin() + static_cast<std::ptrdiff_t>(bounds[1]),
+                     cmp);
+    for (auto &t : threads) t.join();
+
+    for (size_t i=2; i<=nslices; ++i) {
+      std::inplace_merge(run.begin(),
+                         run.begin() + static_cast<std::ptrdiff_t>(bounds[i - 1]),
+                         run.begin() + static_cast<std::ptrdiff_t>(bounds[i]), cmp);
+    }
+    times.sort += elapsed(start);
+  }
+
+  // Write a sorted run to a new temporary file
+  void spill_run(std::vector<record> &run) {
+    auto start = clock::now();
+    std::string filename = make_temp_file();
+    csvwriter tmp(filename, header);
+    for (auto &r : run) tmp << r.fields;
+    if (!tmp) throw csvstream_exception("Error writing file: " + filename);
+    times.runs += 1;
+    times.spill += elapsed(start);
+  }
+
+  // Merge sorted runs into out.  Ties are broken by run order, which keeps
+  // the sort stable.
+  void merge(const std::vector<std::string> &inputs, csvwriter &out) {
+    std::vector<std::unique_ptr<csvstream> > streams;
+    std::vector<record> heads(inputs.size());
+    auto cmp = [this, &heads](size_t a, size_t b) {
+      // priority_queue is a max heap, so reverse the comparison
+      if (less(heads[b], heads[a])) return true;
+      if (less(heads[a], heads[b])) return false;
+      return a > b;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(cmp)> queue(cmp);
+
+    for (size_t i=0; i<inputs.size(); ++i) {
+      streams.emplace_back(new csvstream(inputs[i]));
+      if (*streams[i] >> heads[i].fields) {
+        parse_key(heads[i]);
+        queue.push(i);
+      }
+    }
+
+    while (!queue.empty()) {
+      size_t i = queue.top();
+      queue.pop();
+      out << heads[i].fields;
+      if (*streams[i] >> heads[i].fields) {
+        parse_key(heads[i]);
+        queue.push(i);
+      }
+    }
+  }
+
+  // Create an empty temporary file and remember it for cleanup
+  std::string make_temp_file() {
+    std::string path = temp_dir + "/csvsort.XXXXXX";
+    std::vector<char> buf(path.begin(), path.end());
+    buf.push_back('\0');
+    int fd = mkstemp(buf.data());
+    if (fd < 0) {
+      throw csvstream_exception("Error creating temporary file in: " +
+                                temp_dir);
+    }
+    close(fd);
+    temp_files.push_back(buf.data());
+    return temp_files.back();
+  }
+
+  static void remove_files(const std::vector<std::string> &files) {
+    for (auto &f : files) std::remove(f.c_str());
+  }
+
+  void remove_temp_files() {
+    remove_files(temp_files);
+    temp_files.clear();
+  }
+};
+
+#endif
@@ -0,0 +1,146 @@
+/* csvsort_test.cpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ */
+
+#include "csvsort.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+
+void test_sort_in_memory();
+void test_sort_external();
+void test_sort_numeric();
+void test_sort_parallel();
+void test_sort_no_such_column();
+
+
+int main() {
+  test_sort_in_memory();
+  test_sort_external();
+  test_sort_numeric();
+  test_sort_parallel();
+  test_sort_no_such_column();
+  cout << "csvsort_test PASSED\n";
+  return 0;
+}
+
+
+// Sort a string of CSV and return the output CSV
+string sort_string(const string &input, csvsort &sorter) {
+  stringstream iss(input);
+  ostringstream oss;
+  csvstream csvin(iss);
+  csvwriter csvout(oss, csvin.getheader());
+  sorter.sort(csvin, csvout);
+  return oss.str();
+}
+
+
+void test_sort_in_memory() {
+  // Test sorting an input that fits in memory, including a multiline quoted
+  // field and a stable order for equal keys
+
+  string input = "name,animal\nOscar,cat\n\"Myrtle\nII\",chicken\n"
+                 "Fergie,horse\nBella,cat\n";
+  string output_correct = "name,animal\nOscar,cat\nBella,cat\n"
+                          "\"Myrtle\nII\",chicken\nFergie,horse\n";
+
+  csvsort sorter("animal");
+  string output_observed = sort_string(input, sorter);
+  assert(output_observed == output_correct);
+  assert(sorter.getstats().rows == 4);
+  assert(sorter.getstats().runs == 0);
+}
+
+
+void test_sort_external() {
+  // Test sorting with a small memory budget, which spills many runs to
+  // temporary files and merges them in more than one pass
+
+  // Input in reverse order, with quoted delimiters and line endings
+  ostringstream input;
+  input << "id,comment\n";
+  for (int i=9999; i>=0; --i) {
+    input << "key" << 100000 + i / 2 << ",\"row " << i << ",\nend\"\n";
+  }
+
+  // Correct answer: sorted keys, equal keys keep their input order
+  ostringstream output_correct;
+  output_correct << "id,comment\n";
+  for (int k=0; k<5000; ++k) {
+    for (int i : {2 * k + 1, 2 * k}) {
+      output_correct << "key" << 100000 + k << ",\"row " << i << ",\nend\"\n";
+    }
+  }
+
+  csvsort sorter("id", csvsort::LEXICAL, 4096);
+  string output_observed = sort_string(input.str(), sorter);
+  assert(output_observed == output_correct.str());
+  assert(sorter.getstats().runs > 64);
+}
+
+
+void test_sort_numeric() {
+  // Test numeric keys, with non-numeric keys sorted last
+
+  string input = "x,y\n10,a\n9.5,b\n,c\n-1e3,d\nabc,e\n100,f\n";
+  string output_lexical = "x,y\n,c\n-1e3,d\n10,a\n100,f\n9.5,b\nabc,e\n";
+  string output_numeric = "x,y\n-1e3,d\n9.5,b\n10,a\n100,f\n,c\nabc,e\n";
+
+  csvsort lexical("x");
+  string output_observed = sort_string(input, lexical);
+  assert(output_observed == output_lexical);
+
+  csvsort numeric("x", csvsort::NUMERIC);
+  output_observed = sort_string(input, numeric);
+  assert(output_observed == output_numeric);
+
+  // Same result when every row is its own run, including with a budget of 0
+  for (size_t budget : {1u, 0u}) {
+    csvsort numeric_external("x", csvsort::NUMERIC, budget);
+    output_observed = sort_string(input, numeric_external);
+    assert(output_observed == output_numeric);
+    assert(numeric_external.getstats().runs == 6);
+  }
+}
+
+
+void test_sort_parallel() {
+  // Test that sorting runs with several threads gives the same output
+
+  ostringstream input;
+  input << "n,s\n";
+  for (int i=0; i<20000; ++i) {
+    input << i * 7919 % 1000 << "," << i << "\n";
+  }
+
+  csvsort serial("n", csvsort::NUMERIC);
+  csvsort parallel("n", csvsort::NUMERIC, 64 * 1024,
+                   csvsort::default_temp_dir(), 4);
+  string output_serial = sort_string(input.str(), serial);
+  string output_parallel = sort_string(input.str(), parallel);
+  assert(output_serial == output_parallel);
+}
+
+
+void test_sort_no_such_column() {
+  // Test error condition: the key column doesn't exist
+
+  csvsort sorter("color");
+  try {
+    sort_string("name,animal\nOscar,cat\n", sorter);
+  } catch(const csvstream_exception &e) {
+    //if we caught an exception, then it worked
+    return;
+  }
+
+  // if we made it this far, then it didn't work
+  assert(0);
+}
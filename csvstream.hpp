@@ -18,6 +18,17 @@
 #include <map>
 #include <regex>
 #include <exception>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#if defined(__unix__) || defined(__APPLE__)
+#define CSVSTREAM_HAVE_PREAD 1
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
 
 
 // A custom exception type
@@ -31,21 +42,382 @@ public:
 };
 
 
+// FNV-1a hash of a sequence of bytes.  Pass the result of a previous call as h
+// to continue hashing where it left off.
+inline uint64_t csvstream_hash(const char *data, size_t size,
+                               uint64_t h=14695981039346656037ULL) {
+  for (size_t i=0; i<size; ++i) {
+    h ^= static_cast<unsigned char>(data[i]);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+
+// A position in a CSV input saved by csvstream::checkpoint().  A checkpoint is
+// always between rows, so there's no partly parsed row to save.  It can be
+// written to and read from a stream as seven numbers.
+struct csvcheckpoint {
+  csvcheckpoint()
+    : offset(0), line_no(0), header_hash(0), data_hash(0),
+      file_size(0), file_id(0), file_mtime(0) {}
+
+  // Byte offset of the next row, from the beginning of the input
+  uint64_t offset;
+
+  // Number of rows before offset
+  uint64_t line_no;
+
+  // Hash of the header
+  uint64_t header_hash;
+
+  // Hash of the bytes just before offset, which identifies the input
+  uint64_t data_hash;
+
+  // Size of the input, and the file's inode number and modification time in
+  // nanoseconds.  The inode number and time are 0 if they aren't known.
+  uint64_t file_size;
+  uint64_t file_id;
+  uint64_t file_mtime;
+};
+
+inline std::ostream & operator<< (std::ostream &os, const csvcheckpoint &cp) {
+  return os << cp.offset << " " << cp.line_no << " "
+            << cp.header_hash << " " << cp.data_hash << " "
+            << cp.file_size << " " << cp.file_id << " " << cp.file_mtime;
+}
+
+inline std::istream & operator>> (std::istream &is, csvcheckpoint &cp) {
+  return is >> cp.offset >> cp.line_no >> cp.header_hash >> cp.data_hash
+            >> cp.file_size >> cp.file_id >> cp.file_mtime;
+}
+
+
+// A row read by csvstream that keeps the raw text of each value.  Quotes are
+// removed from a value the first time it's accessed, and the result is cached.
+// Access by column name needs the csvstream that read the row.
+class csvrow {
+public:
+  csvrow() : header(nullptr) {}
+
+  // Return number of values
+  size_t size() const {
+    return fields.size();
+  }
+
+  // Return the value in column i
+  const std::string & operator[] (size_t i) const {
+    if (!decoded[i]) {
+      decode(i, values[i]);
+      decoded[i] = true;
+    }
+    return values[i];
+  }
+
+  // Return the value in a named column.  Throws csvstream_exception if there
+  // is no such column.
+  const std::string & operator[] (const std::string &name) const {
+    if (header) {
+      for (size_t i=0; i<header->size() && i<size(); ++i) {
+        if ((*header)[i] == name) return (*this)[i];
+      }
+    }
+    throw csvstream_exception("No such column: " + name);
+  }
+
+  // Return a hash of the raw text of every value, without removing quotes.
+  // Rows with equal text have equal hashes, but the same value written with
+  // and without quotes hashes differently.
+  uint64_t hash() const {
+    uint64_t h = csvstream_hash(raw.data(), raw.size());
+    for (auto &f : fields) {
+      uint64_t end = f.end;
+      h = csvstream_hash(reinterpret_cast<const char *>(&end), sizeof(end), h);
+    }
+    return h;
+  }
+
+private:
+  friend class csvstream;
+
+  // Boundaries of one value in the raw text.  quoted is true if the value
+  // contains quotes that must be removed.
+  struct field {
+    explicit field(size_t begin) : begin(begin), end(begin), quoted(false) {}
+    size_t begin;
+    size_t end;
+    bool quoted;
+  };
+
+  // Raw text of the line, without delimiters or the line ending
+  std::string raw;
+
+  // Boundaries of each value
+  std::vector<field> fields;
+
+  // Cached values, valid where decoded is true
+  mutable std::vector<std::string> values;
+  mutable std::vector<bool> decoded;
+
+  // Header of the csvstream that read this row
+  const std::vector<std::string> *header;
+
+  // Prepare to read a new line, keeping allocated memory
+  void reset(const std::vector<std::string> *header) {
+    this->header = header;
+    decoded.clear();
+  }
+
+  // Prepare the cache after the line has been read
+  void resize_cache() {
+    values.resize(fields.size());
+    decoded.assign(fields.size(), false);
+  }
+
+  // Copy value i into out, removing quotes.  Escaped characters are kept along
+  // with their backslash, the same as read_csv_record().
+  void decode(size_t i, std::string &out) const {
+    const field &f = fields[i];
+    if (!f.quoted) {
+      out.assign(raw, f.begin, f.end - f.begin);
+      return;
+    }
+    out.clear();
+    for (size_t j=f.begin; j<f.end; ++j) {
+      char c = raw[j];
+      if (c == '\\') {
+        out += c;
+        if (j + 1 < f.end) out += raw[++j];
+      } else if (c != '"') {
+        out += c;
+      }
+    }
+  }
+};
+
+
+// A stream buffer that reads a file with large pread() calls, instead of the
+// small reads made by std::filebuf.  The kernel is asked to read several
+// buffers ahead, so reads are in flight while rows are parsed.  With
+// direct=true, the file is opened with O_DIRECT where supported, bypassing the
+// page cache.  Reads are then aligned, and each large read is split by the
+// kernel into many device requests.
+class csvreadbuf : public std::streambuf {
+public:
+  // Alignment of buffers, offsets and sizes for O_DIRECT
+  static const size_t alignment = 4096;
+
+  // Number of buffers read ahead when not using O_DIRECT
+  static const size_t readahead = 4;
+
+  csvreadbuf()
+    : fd(-1), data(nullptr), capacity(0), direct(false), start(0), advised(0) {}
+
+  ~csvreadbuf() {
+    close();
+  }
+
+  // Open a file with buffer_size bytes per read.  Return false if open fails,
+  // or if pread() isn't available on this platform.  A read that fails later
+  // throws csvstream_exception, instead of looking like the end of the file.
+  bool open(const std::string &filename, bool direct=false,
+            size_t buffer_size=4 * 1024 * 1024) {
+#ifdef CSVSTREAM_HAVE_PREAD
+    close();
+    this->filename = filename;
+    this->direct = false;
+#ifdef O_DIRECT
+    if (direct) {
+      // Not all file systems support O_DIRECT
+      fd = ::open(filename.c_str(), O_RDONLY | O_DIRECT);
+      this->direct = fd >= 0;
+    }
+#endif
+    if (fd < 0) fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    capacity = (std::max(buffer_size, size_t(alignment)) + alignment - 1) /
+      alignment * alignment;
+    void *p = nullptr;
+    if (posix_memalign(&p, alignment, capacity) != 0) {
+      close();
+      return false;
+    }
+    data = static_cast<char *>(p);
+    start = 0;
+    advised = 0;
+    setg(data, data, data);
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (!this->direct) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return true;
+#else
+    (void) filename;
+    (void) direct;
+    (void) buffer_size;
+    return false;
+#endif
+  }
+
+  // Return true if the file is open
+  bool is_open() const {
+    return fd >= 0;
+  }
+
+  // Return true if the file was opened with O_DIRECT
+  bool is_direct() const {
+    return direct;
+  }
+
+  // Close the file
+  void close() {
+#ifdef CSVSTREAM_HAVE_PREAD
+    if (fd >= 0) ::close(fd);
+    free(data);
+#endif
+    fd = -1;
+    data = nullptr;
+    setg(nullptr, nullptr, nullptr);
+  }
+
+protected:
+  int_type underflow() override {
+    if (gptr() == egptr() && !fill(start + (egptr() - eback()))) {
+      return traits_type::eof();
+    }
+    return traits_type::to_int_type(*gptr());
+  }
+
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                   std::ios_base::openmode which) override {
+    if (dir == std::ios_base::cur) {
+      off += start + (gptr() - eback());
+    } else if (dir == std::ios_base::end) {
+#ifdef CSVSTREAM_HAVE_PREAD
+      struct stat st;
+      if (fd < 0 || fstat(fd, &st) != 0) return pos_type(off_type(-1));
+      off += st.st_size;
+#endif
+    }
+    return seekpos(pos_type(off), which);
+  }
+
+  pos_type seekpos(pos_type sp, std::ios_base::openmode which) override {
+    off_type pos = sp;
+    if (fd < 0 || !(which & std::ios_base::in) || pos < 0) {
+      return pos_type(off_type(-1));
+    }
+    if (pos >= start && pos <= start + (egptr() - eback())) {
+      // Already in the buffer
+      setg(eback(), eback() + (pos - start), egptr());
+    } else {
+      // Read at the new position on the next underflow()
+      start = pos;
+      setg(data, data, data);
+    }
+    return sp;
+  }
+
+private:
+  // Filename.  Used for error messages.
+  std::string filename;
+
+  // File descriptor, or -1
+  int fd;
+
+  // Buffer of capacity bytes, aligned for O_DIRECT
+  char *data;
+  size_t capacity;
+
+  // True if the file was opened with O_DIRECT
+  bool direct;
+
+  // File offset of the beginning of the buffer
+  off_type start;
+
+  // End of the range the kernel was asked to read ahead
+  off_type advised;
+
+  // Disable copying
+  csvreadbuf(const csvreadbuf &);
+  csvreadbuf & operator= (const csvreadbuf &);
+
+  // Fill the buffer with data starting at file offset pos.  Return false at
+  // end of file.  Throws csvstream_exception if the read fails.
+  bool fill(off_type pos) {
+#ifdef CSVSTREAM_HAVE_PREAD
+    off_type align = static_cast<off_type>(alignment);
+    off_type begin = direct ? pos / align * align : pos;
+    ssize_t n = 0;
+    do {
+      n = pread(fd, data, capacity, static_cast<off_t>(begin));
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+      throw csvstream_exception("Error reading file: " + filename + " " +
+                                std::strerror(errno));
+    }
+    if (n <= pos - begin) {
+      start = pos;
+      setg(data, data, data);
+      return false;
+    }
+    start = begin;
+    setg(data, data + (pos - begin), data + n);
+    advise(begin + n);
+    return true;
+#else
+    (void) pos;
+    return false;
+#endif
+  }
+
+  // Ask the kernel to read ahead of offset end
+  void advise(off_type end) {
+#ifdef POSIX_FADV_WILLNEED
+    if (direct) return;
+    off_type window = static_cast<off_type>(capacity * readahead);
+    off_type from = std::max(advised, end);
+    if (from >= end + window) return;
+    posix_fadvise(fd, static_cast<off_t>(from),
+                  static_cast<off_t>(end + window - from),
+                  POSIX_FADV_WILLNEED);
+    advised = end + window;
+#else
+    (void) end;
+#endif
+  }
+};
+
+
 // csvstream interface
 class csvstream {
 public:
+  // How the filename constructor reads the file.  IFSTREAM uses
+  // std::ifstream.  PREAD uses csvreadbuf, with large reads and read ahead.
+  // DIRECT also bypasses the page cache.  PREAD and DIRECT fall back to
+  // IFSTREAM on platforms without pread().
+  enum io_type {IFSTREAM, PREAD, DIRECT};
+
   // Constructor from filename. Throws csvstream_exception if open fails.
-  csvstream(const std::string &filename, char delimiter=',', bool strict=true)
+  csvstream(const std::string &filename, char delimiter=',', bool strict=true,
+            bool validate_utf8=false, io_type io=IFSTREAM)
     : filename(filename),
-      is(fin),
+      fin_is(nullptr),
+      is(fin_is),
       delimiter(delimiter),
       strict(strict),
+      validate_utf8(validate_utf8),
       line_no(0) {
 
     // Open file
-    fin.open(filename.c_str());
-    if (!fin.is_open()) {
-      throw csvstream_exception("Error opening file: " + filename);
+    if (io != IFSTREAM && readbuf.open(filename, io == DIRECT)) {
+      fin_is.rdbuf(&readbuf);
+    } else {
+      fin.open(filename.c_str());
+      if (!fin.is_open()) {
+        throw csvstream_exception("Error opening file: " + filename);
+      }
+      fin_is.rdbuf(fin.rdbuf());
     }
 
     // Process header
@@ -53,15 +425,28 @@ public:
   }
 
   // Constructor from stream
-  csvstream(std::istream &is, char delimiter=',', bool strict=true)
+  csvstream(std::istream &is, char delimiter=',', bool strict=true,
+            bool validate_utf8=false)
     : filename("[no filename]"),
+      fin_is(nullptr),
       is(is),
       delimiter(delimiter),
       strict(strict),
+      validate_utf8(validate_utf8),
       line_no(0) {
     read_header();
   }
 
+  // Constructor from filename that resumes reading at a checkpoint.  Throws
+  // csvstream_exception if open fails, or if the checkpoint doesn't match the
+  // file's header or contents.
+  csvstream(const std::string &filename, const csvcheckpoint &cp,
+            char delimiter=',', bool strict=true, bool validate_utf8=false,
+            io_type io=IFSTREAM)
+    : csvstream(filename, delimiter, strict, validate_utf8, io) {
+    resume(cp);
+  }
+
   // Destructor
   ~csvstream() {
     if (fin.is_open()) fin.close();
@@ -77,6 +462,53 @@ public:
     return header;
   }
 
+  // Return a checkpoint for the position after the last row read.  The input
+  // must be seekable.  Throws csvstream_exception if it isn't.
+  csvcheckpoint checkpoint() {
+    csvcheckpoint cp;
+    cp.offset = static_cast<uint64_t>(tell());
+    cp.line_no = line_no;
+    cp.header_hash = header_hash();
+    cp.data_hash = data_hash(cp.offset);
+    identify(cp);
+    return cp;
+  }
+
+  // Continue reading from a checkpoint taken on the same input.  Throws
+  // csvstream_exception if the header or the bytes before the checkpoint
+  // have changed, if the input is smaller, if the file was replaced by
+  // another, or if it was modified without growing.  Rows appended since the
+  // checkpoint are fine.
+  void resume(const csvcheckpoint &cp) {
+    if (cp.header_hash != header_hash()) {
+      throw csvstream_exception("Checkpoint header does not match. " +
+                                filename);
+    }
+    csvcheckpoint now;
+    identify(now);
+    if (cp.data_hash != data_hash(cp.offset) ||
+        now.file_size < cp.file_size ||
+        (now.file_id && cp.file_id && now.file_id != cp.file_id) ||
+        (now.file_size == cp.file_size && now.file_mtime != cp.file_mtime)) {
+      throw csvstream_exception("Checkpoint does not match file contents. " +
+                                filename + ":L" + std::to_string(cp.line_no));
+    }
+    seek(static_cast<std::streamoff>(cp.offset),
+         static_cast<size_t>(cp.line_no));
+  }
+
+  // Move to a byte offset from the beginning of the input, which must be the
+  // beginning of a row.  line_no is the number of rows before offset, used
+  // for error messages.  Throws csvstream_exception if the seek fails.
+  void seek(std::streamoff offset, size_t line_no) {
+    is.clear();
+    if (!is.seekg(offset)) {
+      throw csvstream_exception("Error seeking to byte " +
+                                std::to_string(offset) + " in " + filename);
+    }
+    this->line_no = line_no;
+  }
+
   // Stream extraction operator reads one row. Throws csvstream_exception if
   // the number of items in a row does not match the header.
   csvstream & operator>> (std::map<std::string, std::string>& row) {
@@ -90,6 +522,22 @@ public:
     return extract_row(row);
   }
 
+  // Stream extraction operator reads one row of values, in column order,
+  // without copying the column names.  Use getheader() for the names.  Throws
+  // csvstream_exception if the number of items in a row does not match the
+  // header.
+  csvstream & operator>> (std::vector<std::string>& row) {
+    return extract_row(row);
+  }
+
+  // Stream extraction operator reads one row without removing quotes.  Quotes
+  // are removed from a value the first time it's accessed.  This is faster
+  // when only a few columns are used.  Throws csvstream_exception if the
+  // number of items in a row does not match the header.
+  csvstream & operator>> (csvrow& row) {
+    return extract_row(row);
+  }
+
 private:
   // Filename.  Used for error messages.
   std::string filename;
@@ -97,6 +545,12 @@ private:
   // File stream in CSV format, used when library is called with filename ctor
   std::ifstream fin;
 
+  // Faster file buffer, used by filename ctor with PREAD or DIRECT
+  csvreadbuf readbuf;
+
+  // Stream reading from fin's buffer or readbuf, used with filename ctor
+  std::istream fin_is;
+
   // Stream in CSV format
   std::istream &is;
 
@@ -108,12 +562,19 @@ private:
   // strict=false, ignore extra values and set missing values to empty string.
   bool strict;
 
+  // Reject input that is not valid UTF-8.  Raise an exception reporting the
+  // line and column of the first invalid byte.
+  bool validate_utf8;
+
   // Line no in file.  Used for error messages
   size_t line_no;
 
   // Store header column names
   std::vector<std::string> header;
 
+  // Reused buffer for reading one line
+  csvrow buffer;
+
   // Disable copying because copying streams is bad!
   csvstream(const csvstream &);
   csvstream & operator= (const csvstream &);
@@ -121,21 +582,193 @@ private:
   /////////////////////////////////////////////////////////////////////////////
   // Implementation
 
-  // Read and tokenize one line from a stream
-  static bool read_csv_line(std::istream &is,
-                            std::vector<std::string> &data,
-                            char delimiter
-                            ) {
+  // Number of bytes before a checkpoint that identify the input
+  static const std::streamoff checkpoint_window = 4096;
+
+  // Return the current byte offset in the input.  Throws csvstream_exception
+  // if the input isn't seekable.
+  std::streamoff tell() {
+    // tellg() fails at end of file, so find the end of the file instead
+    std::ios::iostate state = is.rdstate();
+    is.clear();
+    std::streamoff pos = is.tellg();
+    if (pos >= 0 && (state & std::ios::eofbit)) {
+      is.seekg(0, std::ios::end);
+      pos = is.tellg();
+    }
+    is.clear(state);
+    if (pos < 0) {
+      throw csvstream_exception("Input is not seekable. " + filename);
+    }
+    return pos;
+  }
+
+  // Return a hash of the header
+  uint64_t header_hash() const {
+    uint64_t h = csvstream_hash(&delimiter, 1);
+    for (auto &name : header) {
+      h = csvstream_hash(name.data(), name.size() + 1, h);
+    }
+    return h;
+  }
+
+  // Return a hash of the bytes just before offset, leaving the input position
+  // unchanged.  Throws csvstream_exception if the bytes can't be read.
+  uint64_t data_hash(uint64_t offset) {
+    std::streamoff end = static_cast<std::streamoff>(offset);
+    std::streamoff start = end > checkpoint_window ? end - checkpoint_window : 0;
+    std::string bytes(static_cast<size_t>(end - start), '\0');
+    std::ios::iostate state = is.rdstate();
+    std::streamoff pos = tell();
+    is.clear();
+    is.seekg(start);
+    is.read(&bytes[0], static_cast<std::streamsize>(bytes.size()));
+    bool ok = static_cast<bool>(is);
+    is.clear();
+    is.seekg(pos);
+    is.clear(state);
+    if (!ok) {
+      throw csvstream_exception("Error reading checkpoint data. " + filename);
+    }
+    return csvstream_hash(bytes.data(), bytes.size());
+  }
+
+  // Set the size of the input, and the inode number and modification time of
+  // a file opened by name where they're available
+  void identify(csvcheckpoint &cp) {
+    std::ios::iostate state = is.rdstate();
+    std::streamoff pos = tell();
+    is.clear();
+    is.seekg(0, std::ios::end);
+    std::streamoff size = is.tellg();
+    is.clear();
+    is.seekg(pos);
+    is.clear(state);
+    cp.file_size = size > 0 ? static_cast<uint64_t>(size) : 0;
+    cp.file_id = 0;
+    cp.file_mtime = 0;
+#ifdef CSVSTREAM_HAVE_PREAD
+    struct stat st;
+    if (&is == &fin_is && stat(filename.c_str(), &st) == 0) {
+      cp.file_id = static_cast<uint64_t>(st.st_ino);
+      cp.file_mtime = static_cast<uint64_t>(st.st_mtime) * 1000000000;
+#ifdef __linux__
+      cp.file_mtime += static_cast<uint64_t>(st.st_mtim.tv_nsec);
+#endif
+    }
+#endif
+  }
+
+  // Incremental UTF-8 validator.  Rejects overlong encodings, surrogates and
+  // code points above U+10FFFF.
+  class utf8_validator {
+  public:
+    utf8_validator() : pending(0), lo(0x80), hi(0xBF) {}
+
+    // Return false if byte b can't appear at this point in a UTF-8 sequence
+    bool feed(unsigned char b) {
+      if (pending) {
+        if (b < lo || b > hi) return false;
+        pending -= 1;
+        lo = 0x80;
+        hi = 0xBF;
+        return true;
+      }
+      if (b < 0x80) return true;
+      if (b < 0xC2) return false;
+      if (b < 0xE0) { pending = 1; return true; }
+      if (b < 0xF0) {
+        pending = 2;
+        if (b == 0xE0) lo = 0xA0;  // overlong
+        if (b == 0xED) hi = 0x9F;  // surrogates
+        return true;
+      }
+      if (b < 0xF5) {
+        pending = 3;
+        if (b == 0xF0) lo = 0x90;  // overlong
+        if (b == 0xF4) hi = 0x8F;  // above U+10FFFF
+        return true;
+      }
+      return false;
+    }
+
+    // Feed size bytes, and return the index of the first invalid byte, or size
+    // if every byte is valid.  Between sequences, runs of ASCII bytes are
+    // skipped 8 at a time.
+    size_t feed(const char *data, size_t size) {
+      const uint64_t high_bits = 0x8080808080808080ULL;
+      size_t i = 0;
+      while (i < size) {
+        if (!pending) {
+          uint64_t word = 0;
+          while (i + sizeof(word) <= size) {
+            std::memcpy(&word, data + i, sizeof(word));
+            if (word & high_bits) break;
+            i += sizeof(word);
+          }
+          while (i < size && static_cast<unsigned char>(data[i]) < 0x80) ++i;
+          if (i == size) break;
+        }
+        if (!feed(static_cast<unsigned char>(data[i]))) return i;
+        i += 1;
+      }
+      return size;
+    }
+
+    // Return true if the last sequence was complete
+    bool complete() const {
+      return pending == 0;
+    }
+
+  private:
+    int pending;
+    unsigned char lo;
+    unsigned char hi;
+  };
+
+  // Read and tokenize one line from a stream.  The raw text of the line,
+  // without delimiters or the line ending, is stored in row.raw, and the
+  // boundaries of each value in row.fields.  Quotes and escapes are kept in
+  // the raw text.  When utf8_error is not null, also validate UTF-8 and set
+  // *utf8_error to the column of the first invalid byte, counting from 1, or
+  // to 0 if the line is valid.
+  static bool read_csv_record(std::istream &is,
+                              csvrow &row,
+                              char delimiter,
+                              size_t *utf8_error=nullptr
+                              ) {
 
     // Add entry for first token, start with empty string
-    data.clear();
-    data.push_back(std::string());
+    std::string &raw = row.raw;
+    std::vector<csvrow::field> &fields = row.fields;
+    raw.clear();
+    fields.clear();
+    fields.push_back(csvrow::field(0));
+
+    if (utf8_error) *utf8_error = 0;
 
     // Process one character at a time
     char c = '\0';
     enum State {BEGIN, QUOTED, QUOTED_ESCAPED, UNQUOTED, UNQUOTED_ESCAPED, END};
     State state = BEGIN;
-    while(is.get(c)) {
+
+    // Read characters from the stream buffer directly.  istream::get() checks
+    // the stream's state for every character, which is much slower.  Set the
+    // same flags get() would at the end of the input.
+    typedef std::istream::traits_type traits;
+    std::streambuf *buf = is.rdbuf();
+    if (!is.good() || !buf) {
+      is.setstate(std::ios::failbit);
+      return false;
+    }
+    while(true) {
+      traits::int_type next = buf->sbumpc();
+      if (traits::eq_int_type(next, traits::eof())) {
+        is.setstate(std::ios::eofbit | std::ios::failbit);
+        break;
+      }
+      c = traits::to_char_type(next);
+
       switch (state) {
       case BEGIN:
         // We need this state transition to properly handle cases where nothing
@@ -150,14 +783,18 @@ private:
 
       case UNQUOTED:
         if (c == '"') {
-          // Change states when we see a double quote
+          // Change states when we see a double quote.  Remember to remove
+          // quotes from this field when it's read.
           state = QUOTED;
+          raw += c;
+          fields.back().quoted = true;
         } else if (c == '\\') { //note this checks for a single backslash char
           state = UNQUOTED_ESCAPED;
-          data.back() += c;
+          raw += c;
         } else if (c == delimiter) {
-          // If you see a delimiter, then start a new field with an empty string
-          data.push_back("");
+          // If you see a delimiter, then end this field and start a new one
+          fields.back().end = raw.size();
+          fields.push_back(csvrow::field(raw.size()));
         } else if (c == '\n' || c == '\r') {
           // If you see a line ending *and it's not within a quoted token*, stop
           // parsing the line.  Works for UNIX (\n) and OSX (\r) line endings.
@@ -165,13 +802,13 @@ private:
           state = END;
         } else {
           // Append character to current token
-          data.back() += c;
+          raw += c;
         }
         break;
 
       case UNQUOTED_ESCAPED:
         // If a character is escaped, add it no matter what.
-        data.back() += c;
+        raw += c;
         state = UNQUOTED;
         break;
 
@@ -181,16 +818,14 @@ private:
           state = UNQUOTED;
         } else if (c == '\\') {
           state = QUOTED_ESCAPED;
-          data.back() += c;
-        } else {
-          // Append character to current token
-          data.back() += c;
         }
+        // Append character to current token, including quotes
+        raw += c;
         break;
 
       case QUOTED_ESCAPED:
         // If a character is escaped, add it no matter what.
-        data.back() += c;
+        raw += c;
         state = QUOTED;
         break;
 
@@ -200,8 +835,10 @@ private:
           // nothing, only consume the character.
         } else {
           // If this wasn't a Windows line ending, then put character back for
-          // the next call to read_csv_line()
-          is.unget();
+          // the next call to read_csv_record()
+          if (traits::eq_int_type(buf->sungetc(), traits::eof())) {
+            is.setstate(std::ios::badbit);
+          }
         }
 
         // We're done with this line, so break out of both the switch and loop.
@@ -216,6 +853,25 @@ private:
     }//while
 
   multilevel_break:
+    fields.back().end = raw.size();
+
+    // Validate the values of the line in bulk.  Delimiters aren't in the raw
+    // text, so the column of raw[i] in value k is i + k + 1.  A multibyte
+    // sequence cut off by a delimiter, the line ending or the end of the input
+    // is invalid at the column after it.
+    if (utf8_error) {
+      utf8_validator utf8;
+      for (size_t k=0; k<fields.size() && !*utf8_error; ++k) {
+        const csvrow::field &f = fields[k];
+        size_t i = f.begin + utf8.feed(raw.data() + f.begin, f.end - f.begin);
+        if (i < f.end) {
+          *utf8_error = i + k + 1;
+        } else if (!utf8.complete()) {
+          *utf8_error = f.end + k + 1;
+        }
+      }
+    }
+
     // Clear the failbit if we extracted anything.  This is to mimic the
     // behavior of getline(), which will set the eofbit, but *not* the failbit
     // if a partial line is read.
@@ -225,12 +881,47 @@ private:
     return static_cast<bool>(is);
   }
 
+  // Read and tokenize one line into a lazy row, validating UTF-8 if enabled.
+  // The line number is used for error messages.
+  bool read_record(csvrow &row, size_t line) {
+    row.reset(&header);
+    if (!validate_utf8) return read_csv_record(is, row, delimiter);
+    size_t utf8_error = 0;
+    bool ok = read_csv_record(is, row, delimiter, &utf8_error);
+    if (utf8_error) {
+      auto msg = "Invalid UTF-8. " +
+        filename + ":L" + std::to_string(line) + " " +
+        "column = " + std::to_string(utf8_error) + " "
+        ;
+      throw csvstream_exception(msg);
+    }
+    return ok;
+  }
+
+  // Read and tokenize one line, removing quotes from every value
+  bool read_line(std::vector<std::string> &data, size_t line) {
+    bool ok = read_record(buffer, line);
+    data.resize(buffer.size());
+    for (size_t i=0; i<data.size(); ++i) {
+      buffer.decode(i, data[i]);
+    }
+    return ok;
+  }
+
   // Process header, the first line of the file
   void read_header() {
-    // read first line, which is the header
-    if (!read_csv_line(is, header, delimiter)) {
+    // read first line, which is the header.  Line numbers count data rows, so
+    // the header is line 0.
+    if (!read_line(header, 0)) {
       throw csvstream_exception("error reading header");
     }
+
+    // Remove a leading UTF-8 byte order mark, which would otherwise become part
+    // of the first column name
+    const std::string bom = "\xEF\xBB\xBF";
+    if (header[0].compare(0, bom.size(), bom) == 0) {
+      header[0].erase(0, bom.size());
+    }
   }
 
   // Extract a row into a map
@@ -240,7 +931,7 @@ private:
 
     // Read one line from stream, bail out if we're at the end
     std::vector<std::string> data;
-    if (!read_csv_line(is, data, delimiter)) return *this;
+    if (!read_line(data, line_no + 1)) return *this;
     line_no += 1;
 
     // When strict mode is disabled, coerce the length of the data.  If data is
@@ -276,7 +967,7 @@ private:
 
     // Read one line from stream, bail out if we're at the end
     std::vector<std::string> data;
-    if (!read_csv_line(is, data, delimiter)) return *this;
+    if (!read_line(data, line_no + 1)) return *this;
     line_no += 1;
 
     // When strict mode is disabled, coerce the length of the data.  If data is
@@ -303,6 +994,256 @@ private:
 
     return *this;
   }
+
+  // Extract a row into a lazy row
+  csvstream & extract_row(csvrow& row) {
+    // Read one line from stream into the row, bail out if we're at the end
+    if (!read_record(row, line_no + 1)) {
+      row.fields.clear();
+      row.resize_cache();
+      return *this;
+    }
+    line_no += 1;
+
+    // When strict mode is disabled, coerce the length of the data.  If data is
+    // larger than header, discard extra values.  If data is smaller than header,
+    // pad data with empty strings.
+    if (!strict) {
+      row.fields.resize(header.size(), csvrow::field(row.raw.size()));
+    }
+    row.resize_cache();
+
+    // Check length of data
+    if (row.size() != header.size()) {
+      auto msg = "Number of items in row does not match header. " +
+        filename + ":L" + std::to_string(line_no) + " " +
+        "header.size() = " + std::to_string(header.size()) + " " +
+        "row.size() = " + std::to_string(row.size()) + " "
+        ;
+      throw csvstream_exception(msg);
+    }
+
+    return *this;
+  }
+
+  // Extract a row into a vector of values
+  csvstream & extract_row(std::vector<std::string>& row) {
+    // Read one line from stream into the row, bail out if we're at the end
+    if (!read_line(row, line_no + 1)) {
+      row.clear();
+      return *this;
+    }
+    line_no += 1;
+
+    // When strict mode is disabled, coerce the length of the data.  If data is
+    // larger than header, discard extra values.  If data is smaller than header,
+    // pad data with empty strings.
+    if (!strict) {
+      row.resize(header.size());
+    }
+
+    // Check length of data
+    if (row.size() != header.size()) {
+      auto msg = "Number of items in row does not match header. " +
+        filename + ":L" + std::to_string(line_no) + " " +
+        "header.size() = " + std::to_string(header.size()) + " " +
+        "row.size() = " + std::to_string(row.size()) + " "
+        ;
+      throw csvstream_exception(msg);
+    }
+
+    return *this;
+  }
+};
+
+// csvwriter interface.  Writes CSV that csvstream reads back unchanged with
+// the same delimiter.
+class csvwriter {
+public:
+  // Constructor from filename.  Writes the header.  Throws
+  // csvstream_exception if open fails.
+  csvwriter(const std::string &filename,
+            const std::vector<std::string> &header,
+            char delimiter=',')
+    : filename(filename),
+      os(fout),
+      header(header),
+      delimiter(delimiter),
+      line_no(0) {
+
+    // Open file
+    fout.open(filename.c_str());
+    if (!fout.is_open()) {
+      throw csvstream_exception("Error opening file: " + filename);
+    }
+
+    // Write header
+    write_line(header);
+  }
+
+  // Constructor from stream.  Writes the header.
+  csvwriter(std::ostream &os,
+            const std::vector<std::string> &header,
+            char delimiter=',')
+    : filename("[no filename]"),
+      os(os),
+      header(header),
+      delimiter(delimiter),
+      line_no(0) {
+    write_line(header);
+  }
+
+  // Destructor
+  ~csvwriter() {
+    if (fout.is_open()) fout.close();
+  }
+
+  // Return false if an error flag on underlying stream is set
+  explicit operator bool() const {
+    return static_cast<bool>(os);
+  }
+
+  // Return header written by constructor
+  std::vector<std::string> getheader() const {
+    return header;
+  }
+
+  // Stream insertion operator writes one row of values in column order.
+  // Throws csvstream_exception if the number of items in a row does not match
+  // the header.
+  csvwriter & operator<< (const std::vector<std::string>& row) {
+    check_size(row.size());
+    write_line(row);
+    line_no += 1;
+    return *this;
+  }
+
+  // Stream insertion operator writes one row in header order.  Throws
+  // csvstream_exception if a column is missing.
+  csvwriter & operator<< (const std::map<std::string, std::string>& row) {
+    line.clear();
+    for (size_t i=0; i<header.size(); ++i) {
+      auto it = row.find(header[i]);
+      if (it == row.end()) {
+        throw csvstream_exception("Missing column in row. " + filename +
+                                  ":L" + std::to_string(line_no + 1) + " " +
+                                  "column = " + header[i] + " ");
+      }
+      if (i) line += delimiter;
+      append_field(line, it->second, delimiter);
+    }
+    finish_line();
+    line_no += 1;
+    return *this;
+  }
+
+  // Stream insertion operator writes one row in the row's order.  Throws
+  // csvstream_exception if the number of items in a row does not match the
+  // header.
+  csvwriter & operator<< (const std::vector<std::pair<std::string, std::string> >& row) {
+    check_size(row.size());
+    line.clear();
+    for (size_t i=0; i<row.size(); ++i) {
+      if (i) line += delimiter;
+      append_field(line, row[i].second, delimiter);
+    }
+    finish_line();
+    line_no += 1;
+    return *this;
+  }
+
+  // Append one value to a line of CSV, quoting if needed.  Throws
+  // csvstream_exception if csvstream can't read the value back unchanged,
+  // which happens for an unescaped double quote or a trailing backslash.
+  static void append_field(std::string &line,
+                           const std::string &value,
+                           char delimiter=',') {
+    // A backslash escapes the next character, and both are kept by the
+    // reader.  Quote values containing a delimiter or a line ending.
+    bool quote = false;
+    for (size_t i=0; i<value.size(); ++i) {
+      char c = value[i];
+      if (c == '\\') {
+        if (i + 1 == value.size()) {
+          throw csvstream_exception("Can't write value ending in backslash: " +
+                                    value);
+        }
+        i += 1;
+      } else if (c == '"') {
+        throw csvstream_exception("Can't write value with unescaped quote: " +
+                                  value);
+      } else if (c == delimiter || c == '\n' || c == '\r') {
+        quote = true;
+      }
+    }
+
+    if (quote) line += '"';
+    line += value;
+    if (quote) line += '"';
+  }
+
+  // Append one line of values, ending with a newline, to a buffer.  Throws
+  // csvstream_exception like append_field().
+  static void append_line(std::string &buffer,
+                          const std::vector<std::string> &values,
+                          char delimiter=',') {
+    for (size_t i=0; i<values.size(); ++i) {
+      if (i) buffer += delimiter;
+      append_field(buffer, values[i], delimiter);
+    }
+    buffer += '\n';
+  }
+
+private:
+  // Filename.  Used for error messages.
+  std::string filename;
+
+  // File stream, used when library is called with filename ctor
+  std::ofstream fout;
+
+  // Output stream
+  std::ostream &os;
+
+  // Header column names
+  std::vector<std::string> header;
+
+  // Delimiter between columns
+  char delimiter;
+
+  // Line no in file.  Used for error messages
+  size_t line_no;
+
+  // Reused buffer for formatting one line
+  std::string line;
+
+  // Disable copying because copying streams is bad!
+  csvwriter(const csvwriter &);
+  csvwriter & operator= (const csvwriter &);
+
+  // Throw csvstream_exception if a row size doesn't match the header
+  void check_size(size_t size) const {
+    if (size != header.size()) {
+      auto msg = "Number of items in row does not match header. " +
+        filename + ":L" + std::to_string(line_no + 1) + " " +
+        "header.size() = " + std::to_string(header.size()) + " " +
+        "row.size() = " + std::to_string(size) + " "
+        ;
+      throw csvstream_exception(msg);
+    }
+  }
+
+  // Format and write one line of values
+  void write_line(const std::vector<std::string> &values) {
+    line.clear();
+    append_line(line, values, delimiter);
+    os.write(line.data(), static_cast<std::streamsize>(line.size()));
+  }
+
+  // Write the formatted line
+  void finish_line() {
+    line += '\n';
+    os.write(line.data(), static_cast<std::streamsize>(line.size()));
+  }
 };
 
 #endif
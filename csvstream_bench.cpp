@@ -0,0 +1,564 @@
+/* csvstream_bench.cpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ *
+ * Benchmark read throughput.  With no arguments, benchmark a generated input.
+ * Otherwise, benchmark each CSV file named on the command line.  With --perf,
+ * also report hardware performance counters per byte and per row, on Linux
+ * systems that allow it.  Reading from a file is timed with each of
+ * csvstream's ways of reading files, with the file evicted from the page cache
+ * ("cold") and then cached ("warm").
+ *
+ *   $ ./csvstream_bench
+ *   $ ./csvstream_bench input.csv
+ *   $ ./csvstream_bench --perf input.csv
+ */
+
+#include "csvstream.hpp"
+#include "csvtable.hpp"
+#include "csvjoin.hpp"
+#include "csvwriter_pool.hpp"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <cstdint>
+#include <cstring>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#endif
+#include <unistd.h>
+using namespace std;
+
+
+// Count bytes of heap memory in use by replacing global new and delete.  Each
+// allocation is prefixed with its size.  Not inlined, so the compiler doesn't
+// pair this malloc and free with the caller's new and delete.  Atomic,
+// because the threaded benchmarks allocate from several threads.
+static atomic<size_t> heap_bytes(0);
+const size_t heap_prefix = alignof(max_align_t);
+
+[[gnu::noinline]] void * operator new(size_t size) {
+  char *p = static_cast<char *>(malloc(size + heap_prefix));
+  if (!p) throw bad_alloc();
+  *reinterpret_cast<size_t *>(p) = size;
+  heap_bytes.fetch_add(size, memory_order_relaxed);
+  return p + heap_prefix;
+}
+
+[[gnu::noinline]] void operator delete(void *ptr) noexcept {
+  if (!ptr) return;
+  char *p = static_cast<char *>(ptr) - heap_prefix;
+  size_t size = *reinterpret_cast<size_t *>(p);
+  heap_bytes.fetch_sub(size, memory_order_relaxed);
+  free(p);
+}
+
+// Return bytes of heap memory in use
+size_t heap_in_use() {
+  return heap_bytes.load(memory_order_relaxed);
+}
+
+
+// Hardware performance counters for this process and the threads it starts
+// later, user space only.  Counters that can't be opened, for example in a
+// container or on a system other than Linux, are reported as unavailable.
+// When there are more counters than the CPU has, the kernel takes turns, and
+// counts are scaled up by the fraction of time each counter was running.
+class perf_counters {
+public:
+  static const size_t ncounters = 4;
+
+  perf_counters() {
+    for (size_t i=0; i<ncounters; ++i) fds[i] = -1;
+  }
+
+  ~perf_counters() {
+    close_all();
+  }
+
+  // Open the counters.  Return false if none are available.
+  bool open() {
+    bool any = false;
+#ifdef __linux__
+    const uint64_t configs[ncounters] = {
+      PERF_COUNT_HW_CPU_CYCLES,
+      PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_BRANCH_MISSES,
+      PERF_COUNT_HW_CACHE_MISSES,
+    };
+    for (size_t i=0; i<ncounters; ++i) {
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.size = sizeof(attr);
+      attr.config = configs[i];
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.inherit = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+      any = any || fds[i] >= 0;
+    }
+#endif
+    return any;
+  }
+
+  // Reset and start counting
+  void start() {
+#ifdef __linux__
+    for (int fd : fds) {
+      if (fd < 0) continue;
+      ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  // Stop counting and read the counts.  available[i] is false if counter i
+  // couldn't be opened or read.
+  void stop(uint64_t counts[], bool available[]) {
+    for (size_t i=0; i<ncounters; ++i) {
+      counts[i] = 0;
+      available[i] = false;
+#ifdef __linux__
+      if (fds[i] < 0) continue;
+      ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+      // Count, time enabled and time running
+      uint64_t values[3];
+      if (read(fds[i], values, sizeof(values)) !=
+          static_cast<ssize_t>(sizeof(values)) || values[2] == 0) {
+        continue;
+      }
+      counts[i] = values[0];
+      if (values[2] < values[1]) {
+        counts[i] = static_cast<uint64_t>(static_cast<double>(values[0]) *
+                                          static_cast<double>(values[1]) /
+                                          static_cast<double>(values[2]));
+      }
+      available[i] = true;
+#endif
+    }
+  }
+
+private:
+  int fds[ncounters];
+
+  void close_all() {
+#ifdef __linux__
+    for (int fd : fds) {
+      if (fd >= 0) close(fd);
+    }
+#endif
+  }
+};
+
+const char * const counter_names[perf_counters::ncounters] = {
+  "cycles", "instrs", "br-miss", "cache-miss",
+};
+
+// Counters used by every stopwatch, or null when --perf isn't given
+static perf_counters *counters = nullptr;
+
+
+// Measure wall clock time, and hardware counters if enabled
+class stopwatch {
+public:
+  stopwatch() : seconds(0) {
+    for (size_t i=0; i<perf_counters::ncounters; ++i) {
+      counts[i] = 0;
+      available[i] = false;
+    }
+    if (counters) counters->start();
+    start_time = chrono::steady_clock::now();
+  }
+
+  void stop() {
+    auto stop_time = chrono::steady_clock::now();
+    if (counters) counters->stop(counts, available);
+    seconds = chrono::duration<double>(stop_time - start_time).count();
+  }
+
+  double seconds;
+  uint64_t counts[perf_counters::ncounters];
+  bool available[perf_counters::ncounters];
+
+private:
+  chrono::steady_clock::time_point start_time;
+};
+
+
+// Generate a CSV file with a mix of short, long, quoted and non-ASCII fields
+string generate_input(size_t nrows) {
+  ostringstream oss;
+  oss << "id,name,city,amount,comment\n";
+  const vector<string> cities = {"Ann Arbor", "M\xC3\xBCnchen", "\"Paris, TX\""};
+  for (size_t i=0; i<nrows; ++i) {
+    oss << i << ","
+        << "name" << i % 1000 << ","
+        << cities[i % cities.size()] << ","
+        << i * 7 % 10000 << ".25,"
+        << "\"a somewhat longer comment, with a comma, for row " << i << "\"\n";
+  }
+  return oss.str();
+}
+
+
+// Print hardware counts divided by n
+void report_counts(const string &name, const stopwatch &t, size_t n) {
+  cout << "      " << left << setw(10) << name << right;
+  for (size_t i=0; i<perf_counters::ncounters; ++i) {
+    cout << setw(10);
+    if (t.available[i]) {
+      cout << setprecision(2)
+           << static_cast<double>(t.counts[i]) / static_cast<double>(n);
+    } else {
+      cout << "n/a";
+    }
+    cout << " " << counter_names[i];
+  }
+  cout << "\n";
+}
+
+
+// Print one benchmark result
+void report(const string &name, size_t nbytes, size_t nrows,
+            const stopwatch &t) {
+  cout << "  " << left << setw(24) << name << right
+       << fixed << setprecision(1)
+       << setw(8) << static_cast<double>(nbytes) / t.seconds / 1e6 << " MB/s"
+       << setw(10) << static_cast<double>(nrows) / t.seconds / 1e3
+       << " Krows/s\n";
+  if (counters) {
+    report_counts("per byte", t, nbytes);
+    report_counts("per row", t, nrows);
+  }
+}
+
+
+// Time reading every row of an input with one of the row types
+template <typename Row>
+stopwatch time_read(const string &input, bool validate_utf8, size_t &nrows) {
+  stringstream iss(input);
+  stopwatch t;
+  csvstream csvin(iss, ',', true, validate_utf8);
+  Row row;
+  nrows = 0;
+  while (csvin >> row) nrows += 1;
+  t.stop();
+  return t;
+}
+
+
+// Report heap bytes per row for loading a whole input into memory
+void report_memory(const string &name, size_t nbytes, size_t nrows) {
+  cout << "  " << left << setw(24) << name << right
+       << fixed << setprecision(1)
+       << setw(8) << static_cast<double>(nbytes) / static_cast<double>(nrows)
+       << " bytes/row\n";
+}
+
+
+// Load an input as a vector of map rows and as a csvtable, and report load
+// time and memory
+void bench_memory(const string &input) {
+  size_t before = 0;
+  size_t nrows = 0;
+
+  {
+    stringstream iss(input);
+    csvstream csvin(iss);
+    before = heap_in_use();
+    stopwatch t;
+    vector<map<string, string>> rows;
+    map<string, string> row;
+    while (csvin >> row) rows.push_back(row);
+    t.stop();
+    nrows = rows.size();
+    report("load map rows", input.size(), nrows, t);
+    report_memory("load map rows", heap_in_use() - before, nrows);
+  }
+
+  {
+    stringstream iss(input);
+    csvstream csvin(iss);
+    before = heap_in_use();
+    stopwatch t;
+    csvtable table(csvin);
+    t.stop();
+    report("load csvtable", input.size(), nrows, t);
+    report_memory("load csvtable", heap_in_use() - before, nrows);
+  }
+}
+
+
+// Load a file as a csvtable, which reserves memory from the file's size, and
+// report load time and memory
+void bench_table_file(const string &filename, size_t nbytes) {
+  size_t before = heap_in_use();
+  stopwatch t;
+  csvtable table(filename);
+  t.stop();
+  report("load csvtable, file", nbytes, table.size(), t);
+  report_memory("load csvtable, file", heap_in_use() - before, table.size());
+}
+
+
+// Generate a dimension table keyed by id, to join with a generated input
+string generate_dimension(size_t nrows) {
+  ostringstream oss;
+  oss << "id,label,region,notes\n";
+  for (size_t i=0; i<nrows; ++i) {
+    oss << i << ",label" << i << ",region" << i % 50 << ","
+        << "\"notes that the join does not keep\"\n";
+  }
+  return oss.str();
+}
+
+
+// Join the generated input with a dimension table, and compare build memory
+// with a map of map rows
+void bench_join(const string &input, const string &dimension) {
+  size_t before = 0;
+  size_t nrows = 0;
+
+  {
+    stringstream build_iss(dimension);
+    csvstream build(build_iss);
+    before = heap_in_use();
+    map<string, map<string, string>> rows;
+    map<string, string> row;
+    while (build >> row) {
+      rows[row["id"]] = row;
+    }
+    report_memory("join build, map rows", heap_in_use() - before, rows.size());
+  }
+
+  stringstream build_iss(dimension);
+  stringstream probe_iss(input);
+  csvstream build(build_iss);
+  csvstream probe(probe_iss);
+  before = heap_in_use();
+  csvjoin join(build, "id", {"label", "region"},
+               probe, "id", {"id", "amount"}, csvjoin::LEFT);
+  report_memory("join build, csvjoin", heap_in_use() - before,
+                join.build_size());
+
+  stopwatch t;
+  vector<string> row;
+  while (join >> row) nrows += 1;
+  t.stop();
+  report("join probe", input.size(), nrows, t);
+}
+
+
+// Time writing every row of an input with csvwriter and csvwriter_pool
+void bench_write(const string &input) {
+  stringstream iss(input);
+  csvstream csvin(iss);
+  vector<vector<string>> rows;
+  vector<string> row;
+  while (csvin >> row) rows.push_back(row);
+
+  stopwatch t_serial;
+  ostringstream serial;
+  {
+    csvwriter csvout(serial, csvin.getheader());
+    for (auto &r : rows) csvout << r;
+  }
+  t_serial.stop();
+  report("write csvwriter", serial.str().size(), rows.size(), t_serial);
+
+  stopwatch t_parallel;
+  ostringstream parallel;
+  {
+    csvwriter_pool csvout(parallel, csvin.getheader());
+    for (auto &r : rows) csvout << r;
+  }
+  t_parallel.stop();
+  report("write csvwriter_pool", parallel.str().size(), rows.size(),
+         t_parallel);
+}
+
+
+// Time reading every row of an input lazily, accessing only the last column
+stopwatch time_lazy_read(const string &input, size_t &nrows) {
+  stringstream iss(input);
+  stopwatch t;
+  csvstream csvin(iss);
+  size_t col = csvin.getheader().size() - 1;
+  csvrow row;
+  nrows = 0;
+  while (csvin >> row) {
+    row[col];
+    nrows += 1;
+  }
+  t.stop();
+  return t;
+}
+
+
+// Drop a file from the page cache, so the next read comes from the device.
+// Return false if that isn't possible.
+bool evict(const string &filename) {
+#if defined(__linux__) && defined(POSIX_FADV_DONTNEED)
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  // Dirty pages can't be dropped, so write them first
+  fdatasync(fd);
+  bool ok = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+  close(fd);
+  return ok;
+#else
+  (void) filename;
+  return false;
+#endif
+}
+
+
+// Time reading every row of a file with one way of reading files
+stopwatch time_file_read(const string &filename, csvstream::io_type io,
+                         size_t &nrows) {
+  stopwatch t;
+  csvstream csvin(filename, ',', true, false, io);
+  vector<string> row;
+  nrows = 0;
+  while (csvin >> row) nrows += 1;
+  t.stop();
+  return t;
+}
+
+
+// Compare the ways of reading a file, with a cold and a warm page cache
+void bench_io(const string &filename, size_t nbytes) {
+  const vector<pair<string, csvstream::io_type>> io_types = {
+    {"ifstream", csvstream::IFSTREAM},
+    {"pread", csvstream::PREAD},
+    {"O_DIRECT", csvstream::DIRECT},
+  };
+  size_t nrows = 0;
+  for (bool cold : {true, false}) {
+    for (auto &io : io_types) {
+      if (cold && !evict(filename)) {
+        cerr << "Warning: can't evict " << filename << " from page cache\n";
+        return;
+      }
+      stopwatch t = time_file_read(filename, io.second, nrows);
+      report((cold ? "cold " : "warm ") + io.first, nbytes, nrows, t);
+    }
+  }
+}
+
+
+// Write a generated input to a temporary file and compare the ways of
+// reading it
+void bench_io_generated(const string &input) {
+  const char *dir = getenv("TMPDIR");
+  string path = string(dir && *dir ? dir : "/tmp") + "/csvstream_bench.XXXXXX";
+  vector<char> buf(path.begin(), path.end());
+  buf.push_back('\0');
+  int fd = mkstemp(buf.data());
+  if (fd < 0) {
+    cerr << "Warning: can't create temporary file in " << path << "\n";
+    return;
+  }
+  close(fd);
+  {
+    ofstream fout(buf.data(), ios::binary);
+    fout << input;
+  }
+  bench_io(buf.data(), input.size());
+  bench_table_file(buf.data(), input.size());
+  remove(buf.data());
+}
+
+
+// Run all benchmarks on one input
+void bench(const string &name, const string &input) {
+  cout << name << " (" << input.size() << " bytes)\n";
+  size_t nrows = 0;
+  stopwatch t;
+
+  t = time_read<map<string, string>>(input, false, nrows);
+  report("map", input.size(), nrows, t);
+
+  t = time_read<map<string, string>>(input, true, nrows);
+  report("map, validate UTF-8", input.size(), nrows, t);
+
+  t = time_read<vector<pair<string, string>>>(input, false, nrows);
+  report("vector", input.size(), nrows, t);
+
+  t = time_read<vector<pair<string, string>>>(input, true, nrows);
+  report("vector, validate UTF-8", input.size(), nrows, t);
+
+  t = time_read<vector<string>>(input, false, nrows);
+  report("values", input.size(), nrows, t);
+
+  t = time_read<csvrow>(input, false, nrows);
+  report("lazy, no columns", input.size(), nrows, t);
+
+  t = time_lazy_read(input, nrows);
+  report("lazy, one column", input.size(), nrows, t);
+
+  bench_memory(input);
+  bench_write(input);
+}
+
+
+int main(int argc, char **argv) {
+  // Parse options
+  vector<string> filenames;
+  perf_counters perf;
+  for (int i=1; i<argc; ++i) {
+    if (string(argv[i]) == "--perf") {
+      counters = &perf;
+    } else {
+      filenames.push_back(argv[i]);
+    }
+  }
+  if (counters && !perf.open()) {
+    cerr << "Warning: hardware performance counters are unavailable\n";
+    counters = nullptr;
+  }
+
+  try {
+    if (filenames.empty()) {
+      string input = generate_input(200000);
+      bench("[generated]", input);
+      bench_join(input, generate_dimension(100000));
+      bench_io_generated(input);
+    }
+    for (auto &filename : filenames) {
+      ifstream fin(filename.c_str());
+      if (!fin.is_open()) {
+        cerr << "Error opening file: " << filename << "\n";
+        return 1;
+      }
+      stringstream buffer;
+      buffer << fin.rdbuf();
+      bench(filename, buffer.str());
+      bench_io(filename, buffer.str().size());
+      bench_table_file(filename, buffer.str().size());
+    }
+  } catch(const csvstream_exception &e) {
+    cerr << "Error: " << e.what() << "\n";
+    return 1;
+  }
+}
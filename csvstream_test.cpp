@@ -7,11 +7,16 @@
  */
 
 #include "csvstream.hpp"
+#include "csvtest.hpp"
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <map>
 #include <vector>
+#include <cstdio>
+#ifdef CSVSTREAM_HAVE_PREAD
+#include <utime.h>
+#endif
 using namespace std;
 
 
@@ -34,6 +39,20 @@ void test_osx_line_endings();
 void test_windows_line_endings();
 void test_strict_notsctrict();
 void test_notstrict_exceptions();
+void test_bom();
+void test_values();
+void test_writer_roundtrip();
+void test_writer_errors();
+void test_lazy_row();
+void test_lazy_row_notstrict();
+void test_checkpoint_resume();
+void test_checkpoint_mismatch();
+void test_io_types();
+void test_lazy_row_hash();
+void test_readbuf();
+void test_stream_state();
+void test_utf8_valid();
+void test_utf8_invalid();
 
 
 int main() {
@@ -56,6 +75,20 @@ int main() {
   test_windows_line_endings();
   test_strict_notsctrict();
   test_notstrict_exceptions();
+  test_bom();
+  test_values();
+  test_writer_roundtrip();
+  test_writer_errors();
+  test_lazy_row();
+  test_lazy_row_notstrict();
+  test_checkpoint_resume();
+  test_checkpoint_mismatch();
+  test_io_types();
+  test_lazy_row_hash();
+  test_readbuf();
+  test_stream_state();
+  test_utf8_valid();
+  test_utf8_invalid();
   cout << "csvstream_test PASSED\n";
   return 0;
 }
@@ -625,3 +658,557 @@ void test_notstrict_exceptions() {
     }
   }
 }
+
+
+void test_bom() {
+  // Test that a UTF-8 byte order mark is removed from the first column name
+
+  // Input
+  stringstream iss("\xEF\xBB\xBF\"a\",b\n1,2\n");
+
+  // Read stream
+  csvstream csvin(iss);
+  assert(csvin.getheader() == vector<string>({"a", "b"}));
+  map<string, string> row;
+  csvin >> row;
+  assert(row["a"] == "1");
+}
+
+
+void test_utf8_valid() {
+  // Test UTF-8 validation with valid multibyte characters
+
+  // Input with 2, 3 and 4 byte sequences
+  stringstream iss("name,city\nJos\xC3\xA9,\xE6\x9D\xB1\xE4\xBA\xAC\n"
+                   "\xF0\x9F\x90\x8E,\"M\xC3\xBCnchen\"\n");
+
+  // Correct answer
+  const vector<map<string, string>> output_correct =
+    {
+      {{"name","Jos\xC3\xA9"},{"city","\xE6\x9D\xB1\xE4\xBA\xAC"}},
+      {{"name","\xF0\x9F\x90\x8E"},{"city","M\xC3\xBCnchen"}},
+    }
+  ;
+
+  // Save actual output
+  vector<map<string, string>> output_observed;
+
+  // Read stream with validation enabled
+  csvstream csvin(iss, ',', true, true);
+  map<string, string> row;
+  try {
+    while (csvin >> row) {
+      output_observed.push_back(row);
+    }
+  } catch(const csvstream_exception &e) {
+    cout << e.what() << endl;
+    assert(0);
+  }
+
+  // Check output
+  assert(output_observed == output_correct);
+}
+
+
+void test_utf8_invalid() {
+  // Test that UTF-8 validation reports the line and column of the first
+  // invalid byte
+
+  // Invalid input strings and the expected location of the error
+  vector<pair<string, string>> inputs = {
+    {"a,b\n1,2\nx,\xFF\n", ":L2 column = 3 "},  // invalid byte
+    {"a,b\n\xC0\xAF,2\n", ":L1 column = 1 "},  // overlong encoding
+    {"a,b\n1,\xED\xA0\x80\n", ":L1 column = 4 "},  // surrogate
+    {"a,b\n1,\xE6\x9D\n", ":L1 column = 5 "},  // truncated sequence
+    {"a,b\n1,\xE6\x9D", ":L1 column = 5 "},  // truncated at end of input
+    {"a,b\n\xC3,2\n", ":L1 column = 2 "},  // truncated by a delimiter
+    {"a,b,c\n,,\xFF\n", ":L1 column = 3 "},  // after empty values
+    {"a,b\n\"0123456789abcdef\n\xC3\xA9xyz\xFF\",2\n",
+     ":L1 column = 24 "},  // after a run of ASCII and a valid sequence
+    {"a,\x80\n1,2\n", ":L0 column = 3 "},  // invalid header
+  };
+
+  for (auto &input : inputs) {
+    stringstream iss(input.first);
+    try {
+      csvstream csvin(iss, ',', true, true);
+      map<string, string> row;
+      while (csvin >> row);
+    } catch(const csvstream_exception &e) {
+      // If we caught an exception at the right place, then it worked
+      assert(string(e.what()).find(input.second) != string::npos);
+      continue;
+    }
+
+    // If we made it this far, then it didn't work
+    assert(0);
+  }
+
+  // Without validation, invalid bytes are passed through
+  stringstream iss("a,b\n1,\xFF\n");
+  csvstream csvin(iss);
+  map<string, string> row;
+  csvin >> row;
+  assert(row["b"] == "\xFF");
+}
+
+
+void test_values() {
+  // Test stream extraction operator for a row of values without column names
+
+  // Input
+  stringstream iss("a,b,c\n1,\"2,22\",3\n4,5,6\n");
+
+  // Correct answer
+  const vector<vector<string>> output_correct =
+    {
+      {"1","2,22","3"},
+      {"4","5","6"},
+    }
+  ;
+
+  // Save actual output
+  vector<vector<string>> output_observed;
+
+  // Read stream
+  csvstream csvin(iss);
+  vector<string> row;
+  try {
+    while (csvin >> row) {
+      output_observed.push_back(row);
+    }
+  } catch(const csvstream_exception &e) {
+    cout << e.what() << endl;
+    assert(0);
+  }
+
+  // Check output
+  assert(output_observed == output_correct);
+
+  // Too many values in strict mode
+  stringstream iss2("a,b\n1,2,3\n");
+  csvstream csvin2(iss2);
+  try {
+    csvin2 >> row;
+  } catch(const csvstream_exception &e) {
+    return;
+  }
+  assert(0);
+}
+
+
+void test_writer_roundtrip() {
+  // Test that csvwriter output reads back unchanged, with each delimiter and
+  // each row type
+
+  // Header and rows with values that need quoting or contain escapes
+  const vector<string> header = {"a", "b|c", "d"};
+  const vector<vector<string>> rows =
+    {
+      {"1", "2,22", "3"},
+      {"", "hello\nworld", "\\\"quoted\\\""},
+      {"tab\there", "a|b", "cr\r"},
+      {"", "", ""},
+    }
+  ;
+
+  for (char delimiter : {',', '\t', '|'}) {
+    // Write rows using each row type
+    stringstream ss;
+    csvwriter csvout(ss, header, delimiter);
+    for (auto &row : rows) {
+      map<string, string> row_map;
+      vector<pair<string, string>> row_pairs;
+      for (size_t i=0; i<header.size(); ++i) {
+        row_map[header[i]] = row[i];
+        row_pairs.push_back({header[i], row[i]});
+      }
+      csvout << row << row_map << row_pairs;
+    }
+
+    // Read rows
+    csvstream csvin(ss, delimiter);
+    assert(csvin.getheader() == header);
+    vector<vector<string>> output_correct;
+    for (auto &row_correct : rows) {
+      for (int i=0; i<3; ++i) output_correct.push_back(row_correct);
+    }
+    vector<vector<string>> output_observed;
+    vector<string> row;
+    while (csvin >> row) output_observed.push_back(row);
+    assert(output_observed == output_correct);
+  }
+}
+
+
+void test_writer_errors() {
+  // Test error conditions: rows of the wrong size, missing columns, and
+  // values that can't be read back unchanged
+
+  ostringstream oss;
+  csvwriter csvout(oss, {"a", "b"});
+  vector<pair<vector<string>, string>> inputs = {
+    {{"1"}, "row.size() = 1"},
+    {{"1", "2", "3"}, "row.size() = 3"},
+    {{"1", "say \"hi\""}, "quote"},
+    {{"1", "trailing\\"}, "backslash"},
+  };
+  for (auto &input : inputs) {
+    try {
+      csvout << input.first;
+      assert(0);
+    } catch(const csvstream_exception &e) {
+      assert(string(e.what()).find(input.second) != string::npos);
+    }
+  }
+
+  map<string, string> row = {{"a", "1"}};
+  try {
+    csvout << row;
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()).find("column = b") != string::npos);
+  }
+}
+
+
+void test_lazy_row() {
+  // Test that a lazy row has the same values as a row of values, with
+  // quotes, escapes, empty values and multiline values
+
+  // Input
+  const string input =
+    "\"a\",b,c\r\n"
+    "\"1,1\",\\\"2\\\",\n"
+    ",\"hello\nworld\",x\"y\"z\n"
+    "\"4,\\\"44\",\\,,6\n";
+
+  // Correct answer
+  vector<vector<string>> output_correct;
+  stringstream iss_correct(input);
+  csvstream csvin_correct(iss_correct);
+  vector<string> row_correct;
+  while (csvin_correct >> row_correct) {
+    output_correct.push_back(row_correct);
+  }
+  assert(output_correct.size() == 3);
+
+  // Read stream, accessing values out of order and more than once
+  stringstream iss(input);
+  csvstream csvin(iss);
+  csvrow row;
+  size_t i = 0;
+  while (csvin >> row) {
+    assert(row.size() == 3);
+    assert(row[2] == output_correct[i][2]);
+    assert(row["a"] == output_correct[i][0]);
+    assert(row[1] == output_correct[i][1]);
+    assert(row[2] == output_correct[i][2]);
+    ++i;
+  }
+  assert(i == output_correct.size());
+  assert(row.size() == 0);
+
+  // Error condition: no such column
+  stringstream iss2("a,b\n1,2\n");
+  csvstream csvin2(iss2);
+  csvin2 >> row;
+  try {
+    row["c"];
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()).find("No such column") != string::npos);
+  }
+}
+
+
+void test_lazy_row_notstrict() {
+  // Test lazy rows with too few or too many values when strict=false
+
+  stringstream iss("a,b,c\n1\n1,2,3,4\n");
+  csvstream csvin(iss, ',', false);
+  csvrow row;
+
+  csvin >> row;
+  assert(row.size() == 3);
+  assert(row[0] == "1" && row[1] == "" && row[2] == "");
+
+  csvin >> row;
+  assert(row.size() == 3);
+  assert(row[0] == "1" && row[1] == "2" && row[2] == "3");
+
+  // Strict mode throws an exception
+  stringstream iss2("a,b,c\n1\n");
+  csvstream csvin2(iss2);
+  try {
+    csvin2 >> row;
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()).find("row.size() = 1") != string::npos);
+  }
+}
+
+
+void test_checkpoint_resume() {
+  // Test saving a checkpoint after each row and resuming from it
+
+  // Input with a multiline value, and no newline at the end
+  const string filename = "csvstream_test_checkpoint.csv";
+  write_file(filename, "a,b\r\n1,\"x\ny\"\r\n2,z\r\n3,\n4,w");
+  const vector<vector<string>> rows_correct =
+    {{"1","x\ny"}, {"2","z"}, {"3",""}, {"4","w"}};
+
+  for (size_t n=0; n<=rows_correct.size(); ++n) {
+    // Read n rows and save a checkpoint as text
+    stringstream saved;
+    {
+      csvstream csvin(filename);
+      vector<string> row;
+      for (size_t i=0; i<n; ++i) csvin >> row;
+      saved << csvin.checkpoint();
+    }
+
+    // Resume and read the rest
+    csvcheckpoint cp;
+    saved >> cp;
+    assert(saved);
+    csvstream csvin(filename, cp);
+    vector<vector<string>> output_observed;
+    vector<string> row;
+    while (csvin >> row) output_observed.push_back(row);
+    assert(output_observed == vector<vector<string>>(
+      rows_correct.begin() + static_cast<ptrdiff_t>(n),
+      rows_correct.end()));
+  }
+
+  // Line numbers in error messages continue from the checkpoint
+  write_file(filename, "a,b\n1,2\n3,4\n5\n");
+  csvcheckpoint cp;
+  {
+    csvstream csvin(filename);
+    vector<string> row;
+    csvin >> row >> row;
+    cp = csvin.checkpoint();
+  }
+  csvstream csvin(filename, cp);
+  vector<string> row;
+  try {
+    csvin >> row;
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()).find(filename + ":L3 ") != string::npos);
+  }
+
+  remove(filename.c_str());
+}
+
+
+void test_checkpoint_mismatch() {
+  // Test error conditions: resuming after the header or the data before the
+  // checkpoint changed
+
+  const string filename = "csvstream_test_checkpoint.csv";
+  write_file(filename, "name,animal\nFergie,horse\nOscar,cat\n");
+  csvcheckpoint cp;
+  {
+    csvstream csvin(filename);
+    map<string, string> row;
+    csvin >> row;
+    cp = csvin.checkpoint();
+  }
+
+  // Appending rows is fine
+  write_file(filename, "name,animal\nFergie,horse\nOscar,cat\nBella,cat\n");
+  {
+    csvstream csvin(filename, cp);
+    map<string, string> row;
+    csvin >> row;
+    assert(row["name"] == "Oscar");
+  }
+
+  vector<pair<string, string>> inputs = {
+    {"name,species\nFergie,horse\nOscar,cat\n", "header"},
+    {"name,animal\nFergie,zebra\nOscar,cat\n", "contents"},
+    {"name,animal\n", "checkpoint"},
+  };
+  for (auto &input : inputs) {
+    write_file(filename, input.first);
+    try {
+      csvstream csvin(filename, cp);
+      assert(0);
+    } catch(const csvstream_exception &e) {
+      assert(string(e.what()).find(input.second) != string::npos);
+    }
+  }
+
+#ifdef CSVSTREAM_HAVE_PREAD
+  // A file rewritten without growing, with the same bytes just before the
+  // checkpoint, and a file replaced by a longer one with the same contents
+  string contents = "name,animal\nFergie,horse\n";
+  for (size_t i=0; i<500; ++i) contents += "Oscar,cat\n";
+  write_file(filename, contents);
+  utimbuf old_time = {1000, 1000};
+  utime(filename.c_str(), &old_time);
+  {
+    csvstream csvin(filename);
+    vector<string> row;
+    while (csvin >> row);
+    cp = csvin.checkpoint();
+  }
+  string rewritten = contents;
+  rewritten.replace(rewritten.find("horse"), 5, "zebra");
+  write_file(filename, rewritten);
+  const string replacement = filename + ".new";
+  write_file(replacement, contents + "Bella,cat\n");
+  for (int i=0; i<2; ++i) {
+    if (i == 1) rename(replacement.c_str(), filename.c_str());
+    try {
+      csvstream csvin(filename, cp);
+      assert(0);
+    } catch(const csvstream_exception &e) {
+      assert(string(e.what()).find("contents") != string::npos);
+    }
+  }
+#endif
+
+  remove(filename.c_str());
+}
+
+
+// Write a file with rows that span several 4 KB blocks, and return its rows
+vector<vector<string>> write_large_file(const string &filename) {
+  ostringstream oss;
+  vector<vector<string>> rows;
+  oss << "id,text\r\n";
+  for (size_t i=0; i<1000; ++i) {
+    string text = "line " + to_string(i) + "\nof row " + to_string(i);
+    oss << i << ",\"" << text << "\"\r\n";
+    rows.push_back({to_string(i), text});
+  }
+  write_file(filename, oss.str());
+  return rows;
+}
+
+
+void test_io_types() {
+  // Test reading a file with each way of reading files, and resuming from a
+  // checkpoint taken with a different way
+  const string filename = "csvstream_test_io.csv";
+  const vector<vector<string>> rows_correct = write_large_file(filename);
+  const vector<csvstream::io_type> io_types =
+    {csvstream::IFSTREAM, csvstream::PREAD, csvstream::DIRECT};
+
+  for (auto io : io_types) {
+    csvstream csvin(filename, ',', true, false, io);
+    assert(csvin.getheader() == vector<string>({"id", "text"}));
+    vector<vector<string>> output_observed;
+    vector<string> row;
+    while (csvin >> row) output_observed.push_back(row);
+    assert(output_observed == rows_correct);
+  }
+
+  for (auto io : io_types) {
+    csvcheckpoint cp;
+    {
+      csvstream csvin(filename, ',', true, false, csvstream::IFSTREAM);
+      vector<string> row;
+      for (size_t i=0; i<500; ++i) csvin >> row;
+      cp = csvin.checkpoint();
+    }
+    csvstream csvin(filename, cp, ',', true, false, io);
+    vector<string> row;
+    csvin >> row;
+    assert(row == rows_correct[500]);
+  }
+
+  remove(filename.c_str());
+}
+
+
+void test_readbuf() {
+  // Test csvreadbuf with a buffer smaller than the file, so rows cross
+  // buffer boundaries, and seeking outside the buffer
+  const string filename = "csvstream_test_io.csv";
+  const vector<vector<string>> rows_correct = write_large_file(filename);
+
+  for (bool direct : {false, true}) {
+    csvreadbuf buf;
+    buf.open(filename, direct, csvreadbuf::alignment);
+    assert(buf.is_open());
+    istream in(&buf);
+    csvstream csvin(in);
+    vector<vector<string>> output_observed;
+    vector<string> row;
+    while (csvin >> row) output_observed.push_back(row);
+    assert(output_observed == rows_correct);
+
+    // Seek back to the header, and to the end
+    in.clear();
+    in.seekg(0);
+    string line;
+    getline(in, line);
+    assert(line == "id,text\r");
+    in.seekg(0, ios::end);
+    assert(in.tellg() > streampos(4 * csvreadbuf::alignment));
+    getline(in, line);
+    assert(!in);
+  }
+
+  csvreadbuf buf;
+  buf.open("csvstream_test_no_such_file.csv");
+  assert(!buf.is_open());
+  remove(filename.c_str());
+
+#ifdef CSVSTREAM_HAVE_PREAD
+  // Test error condition: a read that fails isn't the end of the file.
+  // Reading a directory fails with EISDIR.
+  try {
+    csvstream csvin(".", ',', true, false, csvstream::PREAD);
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()).find("Error reading file: .") != string::npos);
+  }
+#endif
+}
+
+
+void test_stream_state() {
+  // Test that the tokenizer, which reads from the stream buffer directly,
+  // leaves the stream in the same state as reading with istream::get().
+  // Mixed line endings put back the character read after a line ending.
+  stringstream iss("a,b\r1,2\r\n3,4\n5,6\r");
+  csvstream csvin(iss);
+  vector<vector<string>> rows;
+  vector<string> row;
+  while (csvin >> row) rows.push_back(row);
+  assert(rows == vector<vector<string>>({{"1", "2"}, {"3", "4"}, {"5", "6"}}));
+  assert(iss.eof() && iss.fail() && !iss.bad());
+
+  // Reading again after the end doesn't touch the buffer
+  csvin >> row;
+  assert(!csvin);
+  assert(row.empty());
+
+  // The last row may end without a line ending
+  stringstream iss_partial("a,b\n1,2");
+  csvstream csvin_partial(iss_partial);
+  csvin_partial >> row;
+  assert(csvin_partial);
+  assert(row == vector<string>({"1", "2"}));
+  csvin_partial >> row;
+  assert(!csvin_partial);
+}
+
+
+void test_lazy_row_hash() {
+  // Test hashing the raw text of a row
+  stringstream iss("a,b\nx,yz\nx,yz\nxy,z\n\"x\",yz\n");
+  csvstream csvin(iss);
+  csvrow row;
+  vector<uint64_t> hashes;
+  while (csvin >> row) hashes.push_back(row.hash());
+  assert(hashes.size() == 4);
+  assert(hashes[0] == hashes[1]);
+  assert(hashes[0] != hashes[2]);
+  assert(hashes[0] != hashes[3]);
+}
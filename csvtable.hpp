@@ -0,0 +1,368 @@
+/* -*- mode: c++ -*- */
+#ifndef CSVTABLE_HPP
+#define CSVTABLE_HPP
+/* csvtable.hpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ *
+ * Load a whole CSV file into memory.  Columns with few distinct values, like
+ * "country" or "status", are stored as small integer codes into a dictionary
+ * of distinct values.  Other columns store their values back to back in one
+ * contiguous byte array per column, with the end offset of each value, so a
+ * value costs its bytes plus 8 instead of a std::string and its allocation.
+ */
+
+#include "csvstream.hpp"
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+
+// csvtable interface
+class csvtable {
+public:
+  // Dictionary code type.  Values of a dictionary column with equal codes are
+  // equal.
+  typedef uint32_t code_t;
+
+  // A value stored in the table, without copying it.  Valid as long as the
+  // table is.
+  struct value_view {
+    const char *data;
+    size_t size;
+
+    std::string str() const {
+      return std::string(data, size);
+    }
+
+    bool operator== (const std::string &s) const {
+      return s.size() == size && std::memcmp(s.data(), data, size) == 0;
+    }
+
+    bool operator!= (const std::string &s) const {
+      return !(*this == s);
+    }
+  };
+
+  // Load every remaining row from a csvstream.  A column is stored as a
+  // dictionary until it has more than max_dictionary_size distinct values.
+  // Throws csvstream_exception if the table uses more than memory_budget
+  // bytes.  A budget of 0 means no limit.
+  explicit csvtable(csvstream &csvin, size_t max_dictionary_size=256,
+                    size_t memory_budget=0)
+    : source("[no filename]"),
+      max_dictionary_size(max_dictionary_size),
+      memory_budget(memory_budget),
+      nrows(0),
+      presized(false) {
+    load(csvin, 0);
+  }
+
+  // Load every row of a file.  After the first rows, the file's size is used
+  // to estimate the size of the table.  Memory for the whole table is
+  // reserved at once, and if the estimate is more than memory_budget bytes,
+  // loading stops right away with a csvstream_exception.
+  csvtable(const std::string &filename, char delimiter=',',
+           size_t max_dictionary_size=256, size_t memory_budget=0)
+    : source(filename),
+      max_dictionary_size(max_dictionary_size),
+      memory_budget(memory_budget),
+      nrows(0),
+      presized(false) {
+    csvstream csvin(filename, delimiter);
+    std::ifstream fin(filename.c_str(), std::ios::binary | std::ios::ate);
+    uint64_t file_size = fin ? static_cast<uint64_t>(fin.tellg()) : 0;
+    load(csvin, file_size);
+  }
+
+  // Return header column names
+  const std::vector<std::string> & getheader() const {
+    return header;
+  }
+
+  // Return number of rows
+  size_t size() const {
+    return nrows;
+  }
+
+  // Return the index of a column.  Throws csvstream_exception if there is no
+  // such column.
+  size_t column_index(const std::string &name) const {
+    for (size_t i=0; i<header.size(); ++i) {
+      if (header[i] == name) return i;
+    }
+    throw csvstream_exception("No such column: " + name);
+  }
+
+  // Return the value in a row and column, without copying it
+  value_view view(size_t row, size_t col) const {
+    const column &c = columns.at(col);
+    if (c.dictionary) {
+      const std::string &s = c.pool[c.codes.at(row)];
+      value_view v = {s.data(), s.size()};
+      return v;
+    }
+    uint64_t end = c.ends.at(row);
+    uint64_t begin = row ? c.ends[row - 1] : 0;
+    value_view v = {c.bytes.data() + begin, static_cast<size_t>(end - begin)};
+    return v;
+  }
+
+  // Return the value in a row and column
+  std::string at(size_t row, size_t col) const {
+    return view(row, col).str();
+  }
+
+  // Return the value in a row and named column
+  std::string at(size_t row, const std::string &name) const {
+    return at(row, column_index(name));
+  }
+
+  // Return true if a column is stored as dictionary codes
+  bool is_dictionary(size_t col) const {
+    return columns.at(col).dictionary;
+  }
+
+  // Return the dictionary code in a row and column.  Compare codes instead of
+  // strings for fast equality tests.  The column must be a dictionary column.
+  code_t code(size_t row, size_t col) const {
+    const column &c = columns.at(col);
+    if (!c.dictionary) {
+      throw csvstream_exception("Not a dictionary column: " + header[col]);
+    }
+    return c.codes.at(row);
+  }
+
+  // Return the dictionary code for a value, and set found to false if the
+  // value doesn't appear in the column.  The column must be a dictionary
+  // column.
+  code_t find_code(size_t col, const std::string &value, bool &found) const {
+    const column &c = columns.at(col);
+    if (!c.dictionary) {
+      throw csvstream_exception("Not a dictionary column: " + header[col]);
+    }
+    auto it = c.lookup.find(value);
+    found = it != c.lookup.end();
+    return found ? it->second : 0;
+  }
+
+  // Return the distinct values of a dictionary column, indexed by code
+  const std::vector<std::string> & dictionary(size_t col) const {
+    return columns.at(col).pool;
+  }
+
+  // Return approximate bytes of memory allocated for the table's values
+  size_t memory_usage() const {
+    size_t total = 0;
+    for (auto &c : columns) total += memory_usage(c);
+    return total;
+  }
+
+  // Rows read before estimating the size of a table loaded from a file
+  static const size_t estimate_rows = 1024;
+
+private:
+  // One column, stored either as codes into a pool of distinct values, or as
+  // one byte array holding every value and the end offset of each value
+  struct column {
+    column() : dictionary(true) {}
+    bool dictionary;
+    std::vector<code_t> codes;
+    std::vector<std::string> pool;
+    std::unordered_map<std::string, code_t> lookup;
+    std::vector<char> bytes;
+    std::vector<uint64_t> ends;
+  };
+
+  // Filename.  Used for error messages.
+  std::string source;
+
+  // Store header column names once for the whole table
+  std::vector<std::string> header;
+
+  // Dictionary columns with more distinct values are converted to bytes
+  size_t max_dictionary_size;
+
+  // Maximum bytes of memory, or 0 for no limit
+  size_t memory_budget;
+
+  // Number of rows
+  size_t nrows;
+
+  // True after memory for the whole table has been reserved
+  bool presized;
+
+  // Column data
+  std::vector<column> columns;
+
+  // Load every remaining row.  file_size is the size of the input, or 0 if
+  // it's unknown.  The input must be seekable if its size is known.
+  void load(csvstream &csvin, uint64_t file_size) {
+    header = csvin.getheader();
+    columns.resize(header.size());
+
+    // Offset of the first row, to measure the bytes of input per row
+    uint64_t start = file_size ? csvin.checkpoint().offset : 0;
+
+    std::vector<std::string> row;
+    while (csvin >> row) {
+      for (size_t i=0; i<columns.size(); ++i) {
+        append(columns[i], row[i]);
+      }
+      nrows += 1;
+      if (nrows == estimate_rows && file_size) {
+        uint64_t offset = csvin.checkpoint().offset;
+        if (offset > start && file_size > offset) {
+          presize(static_cast<double>(file_size - start) /
+                  static_cast<double>(offset - start));
+        }
+      }
+      if (memory_budget && nrows % estimate_rows == 0) check_budget();
+    }
+    if (memory_budget) check_budget();
+  }
+
+  // Throw csvstream_exception if the table is over its memory budget
+  void check_budget() const {
+    size_t usage = memory_usage();
+    if (usage > memory_budget) {
+      throw csvstream_exception("Table exceeds memory budget. " + source +
+                                ":L" + std::to_string(nrows) + " " +
+                                "memory_usage() = " + std::to_string(usage) +
+                                " memory_budget = " +
+                                std::to_string(memory_budget) + " ");
+    }
+  }
+
+  // Reserve memory for the whole table, which has scale times the rows read
+  // so far.  Throws csvstream_exception if it won't fit in the memory
+  // budget.
+  void presize(double scale) {
+    // Memory per row grows with the number of rows, but dictionaries don't
+    size_t per_row = 0;
+    size_t fixed = 0;
+    for (auto &c : columns) {
+      per_row += row_usage(c, false);
+      fixed += dictionary_usage(c);
+    }
+    double estimate = static_cast<double>(per_row) * scale +
+      static_cast<double>(fixed);
+    if (memory_budget && estimate > static_cast<double>(memory_budget)) {
+      throw csvstream_exception("Table would exceed memory budget. " + source +
+                                " estimated = " +
+                                std::to_string(static_cast<uint64_t>(estimate)) +
+                                " memory_budget = " +
+                                std::to_string(memory_budget) + " ");
+    }
+
+    // Leave a little room for error, within the budget
+    double slack = 1.0625;
+    if (memory_budget && estimate + static_cast<double>(per_row) * scale *
+        (slack - 1) > static_cast<double>(memory_budget)) {
+      slack = 1;
+    }
+    size_t rows = static_cast<size_t>(static_cast<double>(nrows) * scale * slack);
+    for (auto &c : columns) {
+      if (c.dictionary) {
+        c.codes.reserve(rows);
+      } else {
+        c.ends.reserve(rows);
+        c.bytes.reserve(static_cast<size_t>(
+          static_cast<double>(c.bytes.size()) * scale * slack));
+      }
+    }
+    presized = true;
+  }
+
+  // Return approximate bytes of memory allocated for a column
+  static size_t memory_usage(const column &c) {
+    return row_usage(c, true) + dictionary_usage(c);
+  }
+
+  // Return bytes of memory for a column's codes or bytes and offsets, which
+  // grow with each row.  Count memory allocated, or only used.
+  static size_t row_usage(const column &c, bool allocated) {
+    if (allocated) {
+      return c.codes.capacity() * sizeof(code_t) + c.bytes.capacity() +
+        c.ends.capacity() * sizeof(uint64_t);
+    }
+    return c.codes.size() * sizeof(code_t) + c.bytes.size() +
+      c.ends.size() * sizeof(uint64_t);
+  }
+
+  // Return approximate bytes of memory for a column's dictionary
+  static size_t dictionary_usage(const column &c) {
+    size_t total = 0;
+    for (auto &s : c.pool) total += sizeof(std::string) + s.capacity();
+    total += c.lookup.bucket_count() * sizeof(void *);
+    total += c.lookup.size() *
+      (sizeof(std::pair<const std::string, code_t>) + 2 * sizeof(void *));
+    return total;
+  }
+
+  // Make room for n more elements.  Once the table is presized, grow by a
+  // quarter instead of doubling, so a small underestimate doesn't double the
+  // memory used.  Stores are vectors, because std::string::reserve() may
+  // double anyway.
+  template <typename Store>
+  void reserve_more(Store &store, size_t n) const {
+    if (!presized || store.size() + n <= store.capacity()) return;
+    store.reserve(std::max(store.size() + n,
+                           store.capacity() + store.capacity() / 4));
+  }
+
+  // Add one value to the end of a column
+  void append(column &c, const std::string &value) {
+    if (c.dictionary) {
+      auto it = c.lookup.find(value);
+      if (it != c.lookup.end()) {
+        reserve_more(c.codes, 1);
+        c.codes.push_back(it->second);
+        return;
+      }
+      if (c.pool.size() < max_dictionary_size) {
+        code_t code = static_cast<code_t>(c.pool.size());
+        c.lookup.emplace(value, code);
+        c.pool.push_back(value);
+        reserve_more(c.codes, 1);
+        c.codes.push_back(code);
+        return;
+      }
+      convert_to_bytes(c);
+    }
+    reserve_more(c.bytes, value.size());
+    reserve_more(c.ends, 1);
+    c.bytes.insert(c.bytes.end(), value.begin(), value.end());
+    c.ends.push_back(c.bytes.size());
+  }
+
+  // Decode a dictionary column into bytes.  The dictionary is discarded.
+  // Reserve room for as many values as the codes had room for.
+  static void convert_to_bytes(column &c) {
+    size_t nbytes = 0;
+    for (code_t code : c.codes) nbytes += c.pool[code].size();
+    size_t capacity = std::max(c.codes.capacity(), c.codes.size() + 1);
+    c.bytes.reserve(static_cast<size_t>(
+      static_cast<double>(nbytes) * static_cast<double>(capacity) /
+      static_cast<double>(std::max(c.codes.size(), size_t(1)))));
+    c.ends.reserve(capacity);
+    for (code_t code : c.codes) {
+      const std::string &value = c.pool[code];
+      c.bytes.insert(c.bytes.end(), value.begin(), value.end());
+      c.ends.push_back(c.bytes.size());
+    }
+    c.dictionary = false;
+    std::vector<code_t>().swap(c.codes);
+    std::vector<std::string>().swap(c.pool);
+    std::unordered_map<std::string, code_t>().swap(c.lookup);
+  }
+};
+
+#endif
@@ -0,0 +1,207 @@
+/* csvtable_test.cpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ */
+
+#include "csvtable.hpp"
+#include "csvtest.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+using namespace std;
+
+
+void test_load();
+void test_dictionary_columns();
+void test_find_code();
+void test_no_such_column();
+void test_view();
+void test_load_file();
+void test_memory_budget();
+void test_memory_budget_stream();
+
+
+int main() {
+  test_load();
+  test_dictionary_columns();
+  test_find_code();
+  test_no_such_column();
+  test_view();
+  test_load_file();
+  test_memory_budget();
+  test_memory_budget_stream();
+  cout << "csvtable_test PASSED\n";
+  return 0;
+}
+
+
+void test_load() {
+  // Test loading a file and reading values by row and column
+
+  csvstream csvin("input.csv");
+  csvtable table(csvin);
+  assert(table.getheader() == vector<string>({"name", "animal"}));
+  assert(table.size() == 3);
+  assert(table.at(0, 0) == "Fergie");
+  assert(table.at(1, "name") == "Myrtle II");
+  assert(table.at(2, "animal") == "cat");
+}
+
+
+void test_dictionary_columns() {
+  // Test that a column with many distinct values is converted from a
+  // dictionary to strings, while a column with few distinct values stays a
+  // dictionary
+
+  // Input
+  stringstream iss;
+  iss << "id,status\n";
+  for (int i=0; i<100; ++i) {
+    iss << i << "," << (i % 3 ? "open" : "\"closed, done\"") << "\n";
+  }
+
+  // Load with a small dictionary limit
+  csvstream csvin(iss);
+  csvtable table(csvin, 10);
+  assert(table.size() == 100);
+  assert(!table.is_dictionary(0));
+  assert(table.is_dictionary(1));
+  assert(table.dictionary(1).size() == 2);
+
+  // Check values are unchanged
+  for (size_t i=0; i<table.size(); ++i) {
+    assert(table.at(i, "id") == to_string(i));
+    assert(table.at(i, "status") == (i % 3 ? "open" : "closed, done"));
+  }
+}
+
+
+void test_find_code() {
+  // Test equality comparisons using dictionary codes
+
+  stringstream iss("country\nUS\nFR\nUS\nDE\n");
+  csvstream csvin(iss);
+  csvtable table(csvin);
+
+  bool found = false;
+  csvtable::code_t us = table.find_code(0, "US", found);
+  assert(found);
+  assert(table.code(0, 0) == us);
+  assert(table.code(1, 0) != us);
+  assert(table.code(2, 0) == us);
+
+  table.find_code(0, "JP", found);
+  assert(!found);
+}
+
+
+void test_no_such_column() {
+  // Test error condition: access a column that doesn't exist
+
+  csvstream csvin("input.csv");
+  csvtable table(csvin);
+  try {
+    table.at(0, "color");
+  } catch(const csvstream_exception &e) {
+    //if we caught an exception, then it worked
+    return;
+  }
+
+  // if we made it this far, then it didn't work
+  assert(0);
+}
+
+
+// Write a file with an id column, a name column and a status column with few
+// distinct values, and return its contents
+string write_table_file(const string &filename, size_t nrows) {
+  ostringstream oss;
+  oss << "id,name,status\n";
+  for (size_t i=0; i<nrows; ++i) {
+    oss << i << ",\"name " << i << "\"," << (i % 2 ? "open" : "closed") << "\n";
+  }
+  write_file(filename, oss.str());
+  return oss.str();
+}
+
+
+void test_view() {
+  // Test reading values without copying them, from both kinds of column
+  stringstream iss("id,status\n1,open\n22,open\n,closed\n");
+  csvstream csvin(iss, ',');
+  csvtable table(csvin, 1);
+  assert(!table.is_dictionary(0));
+  assert(table.view(1, 0) == "22");
+  assert(table.view(1, 0) != "2");
+  assert(table.view(2, 0).size == 0);
+  assert(table.view(2, 1).str() == "closed");
+}
+
+
+void test_load_file() {
+  // Test loading a file large enough to reserve memory from its size.  The
+  // memory allocated should be close to the memory used.
+  const string filename = "csvtable_test.csv";
+  const size_t nrows = 20000;
+  string contents = write_table_file(filename, nrows);
+
+  csvtable table(filename);
+  assert(table.size() == nrows);
+  assert(!table.is_dictionary(0));
+  assert(!table.is_dictionary(1));
+  assert(table.is_dictionary(2));
+  for (size_t i=0; i<nrows; ++i) {
+    assert(table.view(i, 0) == to_string(i));
+    assert(table.view(i, 1) == "name " + to_string(i));
+    assert(table.at(i, "status") == (i % 2 ? "open" : "closed"));
+  }
+
+  // Values plus 8 bytes per offset and 4 bytes per code, with some room to
+  // spare
+  size_t data_bytes = contents.size() - 4 * nrows;
+  assert(table.memory_usage() < data_bytes + 20 * nrows + data_bytes / 4);
+  remove(filename.c_str());
+}
+
+
+void test_memory_budget() {
+  // Test error condition: a file that won't fit in the memory budget.  The
+  // estimate after the first rows fails before the whole file is read.
+  const string filename = "csvtable_test.csv";
+  write_table_file(filename, 100000);
+  try {
+    csvtable table(filename, ',', 256, 100000);
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()).find("Table would exceed memory budget. " +
+                                 filename) != string::npos);
+  }
+
+  // A large enough budget
+  csvtable table(filename, ',', 256, 8 << 20);
+  assert(table.size() == 100000);
+  assert(table.memory_usage() <= 8 << 20);
+  remove(filename.c_str());
+}
+
+
+void test_memory_budget_stream() {
+  // Test error condition: a stream, whose size isn't known, that grows past
+  // the memory budget
+  stringstream iss;
+  iss << "id\n";
+  for (int i=0; i<10000; ++i) iss << i << "\n";
+  csvstream csvin(iss);
+  try {
+    csvtable table(csvin, 256, 10000);
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()).find("Table exceeds memory budget. "
+                                 "[no filename]:L") != string::npos);
+  }
+}
@@ -0,0 +1,27 @@
+/* -*- mode: c++ -*- */
+#ifndef CSVTEST_HPP
+#define CSVTEST_HPP
+/* csvtest.hpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ *
+ * Helpers shared by the unit tests.
+ */
+
+#include <fstream>
+#include <string>
+#include <cassert>
+
+
+// Write a string to a file
+inline void write_file(const std::string &filename,
+                       const std::string &contents) {
+  std::ofstream fout(filename.c_str(), std::ios::binary);
+  assert(fout.is_open());
+  fout << contents;
+}
+
+#endif
@@ -0,0 +1,452 @@
+/* csvtool.cpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ *
+ * Command line tool for common operations on CSV files.  Rows are streamed,
+ * so memory use doesn't grow with the size of the input.  With -j, a large
+ * file is split into ranges of rows that are processed on several threads
+ * and written in their original order.
+ *
+ *   $ ./csvtool select name,animal input.csv
+ *   $ ./csvtool filter animal cat input.csv
+ *   $ ./csvtool -j 8 count input.csv
+ *   $ ./csvtool head 5 input.csv
+ *   $ ./csvtool tail 5 input.csv
+ *   $ ./csvtool convert tab input.csv
+ */
+
+#include "csvstream.hpp"
+#include "csvshards.hpp"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstdlib>
+using namespace std;
+
+
+// Options and arguments of one command
+struct options {
+  string command;
+  string filename;
+  char delimiter;
+  char out_delimiter;
+  bool strict;
+  bool validate_utf8;
+  size_t nthreads;
+  size_t nrows;
+  vector<string> columns;
+  string value;
+};
+
+
+// Bytes of output collected before writing
+const size_t flush_size = 1 << 20;
+
+// Approximate size of a range of rows processed by one thread
+const size_t split_size = 8 << 20;
+
+
+void usage() {
+  cerr << "Usage: csvtool [options] command [arguments] [file]\n"
+       << "\n"
+       << "Commands:\n"
+       << "  select COLUMN[,COLUMN...]  Print only these columns\n"
+       << "  filter COLUMN VALUE        Print rows where COLUMN equals VALUE\n"
+       << "  count                      Print the number of rows\n"
+       << "  head [N]                   Print the first N rows, default 10\n"
+       << "  tail [N]                   Print the last N rows, default 10\n"
+       << "  convert DELIMITER          Change the delimiter\n"
+       << "\n"
+       << "Options:\n"
+       << "  -d DELIMITER  Input delimiter, default ','\n"
+       << "  -n            Allow too many or too few values in a row\n"
+       << "  -u            Reject input that isn't valid UTF-8\n"
+       << "  -j N          Use N threads for select, filter, count and "
+       << "convert\n"
+       << "\n"
+       << "A delimiter is one character, or \"tab\".  With no file, or \"-\", "
+       << "read standard input.\n";
+  exit(1);
+}
+
+
+// Parse a delimiter argument
+char parse_delimiter(const string &s) {
+  if (s == "tab" || s == "\\t") return '\t';
+  if (s.size() != 1) usage();
+  return s[0];
+}
+
+
+// Parse a count argument
+size_t parse_count(const string &s) {
+  char *end = nullptr;
+  unsigned long long n = strtoull(s.c_str(), &end, 10);
+  if (s.empty() || *end || s[0] == '-') usage();
+  return static_cast<size_t>(n);
+}
+
+
+// Split a comma separated list of column names
+vector<string> split_names(const string &s) {
+  vector<string> names(1);
+  for (char c : s) {
+    if (c == ',') names.emplace_back();
+    else names.back() += c;
+  }
+  return names;
+}
+
+
+// Parse the command line
+options parse_args(int argc, char **argv) {
+  options opt;
+  opt.delimiter = ',';
+  opt.strict = true;
+  opt.validate_utf8 = false;
+  opt.nthreads = 1;
+  opt.nrows = 10;
+
+  // Options
+  int i = 1;
+  for (; i<argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+    string arg = argv[i];
+    if (arg == "-d" && i + 1 < argc) opt.delimiter = parse_delimiter(argv[++i]);
+    else if (arg == "-n") opt.strict = false;
+    else if (arg == "-u") opt.validate_utf8 = true;
+    else if (arg == "-j" && i + 1 < argc) opt.nthreads = parse_count(argv[++i]);
+    else usage();
+  }
+  if (i == argc) usage();
+  if (!opt.nthreads) opt.nthreads = 1;
+  opt.out_delimiter = opt.delimiter;
+
+  // Command and its arguments
+  opt.command = argv[i++];
+  vector<string> args(argv + i, argv + argc);
+  size_t nargs = 0;
+  if (opt.command == "select") {
+    if (args.size() < 1) usage();
+    opt.columns = split_names(args[0]);
+    nargs = 1;
+  } else if (opt.command == "filter") {
+    if (args.size() < 2) usage();
+    opt.columns = {args[0]};
+    opt.value = args[1];
+    nargs = 2;
+  } else if (opt.command == "count") {
+    nargs = 0;
+  } else if (opt.command == "head" || opt.command == "tail") {
+    // The count is optional, so a number followed by a file is a count
+    if (args.size() == 2 || (args.size() == 1 && !args[0].empty() &&
+                             args[0].find_first_not_of("0123456789") ==
+                             string::npos)) {
+      opt.nrows = parse_count(args[0]);
+      nargs = 1;
+    }
+  } else if (opt.command == "convert") {
+    if (args.size() < 1) usage();
+    opt.out_delimiter = parse_delimiter(args[0]);
+    nargs = 1;
+  } else {
+    usage();
+  }
+
+  // Input file
+  if (args.size() > nargs + 1) usage();
+  if (args.size() == nargs + 1) opt.filename = args[nargs];
+  if (opt.filename == "-") opt.filename.clear();
+  return opt;
+}
+
+
+// Return indices of named columns.  Throws csvstream_exception if a column
+// doesn't exist.
+vector<size_t> find_columns(const vector<string> &header,
+                            const vector<string> &names) {
+  vector<size_t> indices;
+  for (auto &name : names) {
+    size_t i = 0;
+    while (i < header.size() && header[i] != name) ++i;
+    if (i == header.size()) {
+      throw csvstream_exception("No such column: " + name);
+    }
+    indices.push_back(i);
+  }
+  return indices;
+}
+
+
+// Processes rows for select, filter, count and convert.  Each thread has its
+// own processor.
+class processor {
+public:
+  processor(const options &opt, const vector<string> &header)
+    : opt(opt), nrows(0) {
+    if (!opt.columns.empty()) columns = find_columns(header, opt.columns);
+  }
+
+  // Return the output header
+  vector<string> output_header(const vector<string> &header) const {
+    if (opt.command != "select") return header;
+    return opt.columns;
+  }
+
+  // Process one row, appending any output to out
+  void row(const csvrow &r, string &out) {
+    nrows += 1;
+    if (opt.command == "count") return;
+    if (opt.command == "filter" && r[columns[0]] != opt.value) return;
+    if (opt.command == "select") {
+      values.resize(columns.size());
+      for (size_t i=0; i<columns.size(); ++i) values[i] = r[columns[i]];
+    } else {
+      values.resize(r.size());
+      for (size_t i=0; i<r.size(); ++i) values[i] = r[i];
+    }
+    csvwriter::append_line(out, values, opt.out_delimiter);
+  }
+
+  // Return number of rows processed
+  size_t size() const {
+    return nrows;
+  }
+
+private:
+  const options &opt;
+  vector<size_t> columns;
+  vector<string> values;
+  size_t nrows;
+};
+
+
+// Write a string and clear it
+void flush(string &out) {
+  cout.write(out.data(), static_cast<streamsize>(out.size()));
+  out.clear();
+}
+
+
+// Process rows with one thread
+size_t run_serial(const options &opt, csvstream &csvin) {
+  processor p(opt, csvin.getheader());
+  string out;
+  if (opt.command != "count") {
+    csvwriter::append_line(out, p.output_header(csvin.getheader()),
+                           opt.out_delimiter);
+  }
+  csvrow row;
+  while (csvin >> row) {
+    p.row(row, out);
+    if (out.size() >= flush_size) flush(out);
+  }
+  flush(out);
+  return p.size();
+}
+
+
+// Process ranges of a file with several threads, writing the output of each
+// range in order.  At most two ranges per thread are buffered.  Ranges are
+// found by another thread, so workers start on the first ranges while the
+// rest of the file is scanned.
+size_t run_parallel(const options &opt,
+                    const vector<string> &header,
+                    const csvshards &shards) {
+  const size_t window = 2 * opt.nthreads;
+  vector<csvshards::task> ranges;
+  bool split_done = false;
+  vector<string> outputs(window);
+  vector<bool> done(window, false);
+  size_t next = 0;
+  size_t written = 0;
+  size_t nrows = 0;
+  exception_ptr error;
+  mutex m;
+  condition_variable cv;
+
+  thread splitter([&]() {
+    exception_ptr e;
+    try {
+      shards.split(0, [&](const csvshards::task &r) {
+        lock_guard<mutex> lock(m);
+        ranges.push_back(r);
+        cv.notify_all();
+      });
+    } catch(...) {
+      e = current_exception();
+    }
+    lock_guard<mutex> lock(m);
+    if (e && !error) error = e;
+    split_done = true;
+    cv.notify_all();
+  });
+
+  auto work = [&]() {
+    unique_lock<mutex> lock(m);
+    while (true) {
+      cv.wait(lock, [&]() {
+        return error || (split_done && next == ranges.size()) ||
+          (next < ranges.size() && next < written + window);
+      });
+      if (error || next == ranges.size()) return;
+      size_t k = next++;
+      // Copy the range, because ranges may grow
+      csvshards::task r = ranges[k];
+      lock.unlock();
+
+      string out;
+      size_t n = 0;
+      exception_ptr e;
+      try {
+        csvstream csvin(opt.filename, opt.delimiter, opt.strict,
+                        opt.validate_utf8);
+        csvin.seek(r.offset, r.line_no);
+        processor p(opt, header);
+        csvrow row;
+        for (size_t i=0; i<r.nrows && csvin >> row; ++i) p.row(row, out);
+        n = p.size();
+      } catch(...) {
+        e = current_exception();
+      }
+
+      lock.lock();
+      if (e && !error) error = e;
+      outputs[k % window].swap(out);
+      done[k % window] = true;
+      nrows += n;
+      cv.notify_all();
+    }
+  };
+
+  vector<thread> threads;
+  for (size_t i=0; i<opt.nthreads; ++i) threads.emplace_back(work);
+
+  string out;
+  for (size_t k=0; ; ++k) {
+    {
+      unique_lock<mutex> lock(m);
+      cv.wait(lock, [&]() {
+        return error || (split_done && k == ranges.size()) ||
+          (k < ranges.size() && done[k % window]);
+      });
+      if (error || k == ranges.size()) break;
+      out.swap(outputs[k % window]);
+      done[k % window] = false;
+      written = k + 1;
+      cv.notify_all();
+    }
+    flush(out);
+  }
+  splitter.join();
+  for (auto &t : threads) t.join();
+  if (error) rethrow_exception(error);
+  return nrows;
+}
+
+
+// Return the size of a file in bytes, or 0 if it can't be opened
+size_t file_size(const string &filename) {
+  ifstream fin(filename.c_str(), ios::binary | ios::ate);
+  streamoff size = fin ? static_cast<streamoff>(fin.tellg()) : 0;
+  return size > 0 ? static_cast<size_t>(size) : 0;
+}
+
+
+// Print the first opt.nrows rows
+void head(const options &opt, csvstream &csvin) {
+  string out;
+  csvwriter::append_line(out, csvin.getheader(), opt.delimiter);
+  vector<string> row;
+  for (size_t i=0; i<opt.nrows && csvin >> row; ++i) {
+    csvwriter::append_line(out, row, opt.delimiter);
+    if (out.size() >= flush_size) flush(out);
+  }
+  flush(out);
+}
+
+
+// Print the last opt.nrows rows, keeping only that many in memory
+void tail(const options &opt, csvstream &csvin) {
+  vector<vector<string>> last(opt.nrows);
+  size_t count = 0;
+  vector<string> row;
+  while (csvin >> row) {
+    if (last.empty()) continue;
+    // Reuse the memory of the row that's replaced
+    last[count % last.size()].swap(row);
+    count += 1;
+  }
+  string out;
+  csvwriter::append_line(out, csvin.getheader(), opt.delimiter);
+  for (size_t i=count - min(count, last.size()); i<count; ++i) {
+    csvwriter::append_line(out, last[i % last.size()], opt.delimiter);
+  }
+  flush(out);
+}
+
+
+int main(int argc, char **argv) {
+  ios_base::sync_with_stdio(false);
+
+  try {
+    options opt = parse_args(argc, argv);
+
+    // Open input
+    unique_ptr<csvstream> csvin;
+    if (opt.filename.empty()) {
+      csvin.reset(new csvstream(cin, opt.delimiter, opt.strict,
+                                opt.validate_utf8));
+    } else {
+      csvin.reset(new csvstream(opt.filename, opt.delimiter, opt.strict,
+                                opt.validate_utf8, csvstream::PREAD));
+    }
+
+    if (opt.command == "head") {
+      head(opt, *csvin);
+    } else if (opt.command == "tail") {
+      tail(opt, *csvin);
+    } else {
+      // Split a large file into ranges for several threads
+      size_t nrows = 0;
+      if (opt.nthreads > 1 && !opt.filename.empty() &&
+          file_size(opt.filename) > split_size) {
+        csvshards shards({opt.filename}, opt.delimiter, opt.strict,
+                         opt.nthreads, split_size);
+        vector<string> header = csvin->getheader();
+        processor p(opt, header);
+        if (opt.command != "count") {
+          string out;
+          csvwriter::append_line(out, p.output_header(header),
+                                 opt.out_delimiter);
+          flush(out);
+        }
+        nrows = run_parallel(opt, header, shards);
+      } else {
+        nrows = run_serial(opt, *csvin);
+      }
+      if (opt.command == "count") cout << nrows << "\n";
+    }
+  } catch(const csvstream_exception &e) {
+    cout.flush();
+    cerr << "Error: " << e.what() << "\n";
+    return 1;
+  } catch(const exception &e) {
+    // For example, running out of memory or failing to start a thread
+    cout.flush();
+    cerr << "Error: " << e.what() << "\n";
+    return 1;
+  }
+
+  cout.flush();
+  return cout ? 0 : 1;
+}
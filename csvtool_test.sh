@@ -0,0 +1,93 @@
+#!/bin/sh
+# csvtool_test.sh
+#
+# Andrew DeOrio <awdeorio@umich.edu>
+#
+# An easy-to-use CSV file parser for C++
+# https://github.com/awdeorio/csvstream
+#
+# Regression test for csvtool.  Exits non-zero on the first failure.
+
+set -e
+
+# Compare the output of a command with the expected output
+check() {
+  expected="$1"
+  shift
+  observed="$("$@")"
+  if [ "$observed" != "$expected" ]; then
+    echo "FAILED: $*"
+    echo "expected:"
+    echo "$expected"
+    echo "observed:"
+    echo "$observed"
+    exit 1
+  fi
+}
+
+# Test each command on the example input
+check "name
+Fergie
+Myrtle II
+Oscar" ./csvtool select name input.csv
+check "animal,name
+horse,Fergie
+chicken,Myrtle II
+cat,Oscar" ./csvtool select animal,name input.csv
+check "name,animal
+Oscar,cat" ./csvtool filter animal cat input.csv
+check "3" ./csvtool count input.csv
+check "name,animal
+Fergie,horse" ./csvtool head 1 input.csv
+check "name,animal
+Myrtle II,chicken
+Oscar,cat" ./csvtool tail 2 input.csv
+check "name	animal
+Fergie	horse
+Myrtle II	chicken
+Oscar	cat" ./csvtool convert tab input.csv
+
+# Test reading standard input and another delimiter
+check "name
+Fergie
+Myrtle II
+Oscar" sh -c "./csvtool convert ';' input.csv | ./csvtool -d ';' select name"
+
+# Test quoting a value that contains the new delimiter
+printf 'a|b\nx,y|z\n' > csvtool_test.csv
+check 'a,b
+"x,y",z' ./csvtool -d '|' convert , csvtool_test.csv
+
+# Test the same output with several threads on a file that is split into
+# ranges
+awk 'BEGIN {
+  print "id,name,comment"
+  for (i = 0; i < 400000; i++) {
+    printf "%d,name%d,\"a comment,\nwith a line ending %d\"\n", i, i % 100, i
+  }
+}' > csvtool_test.csv
+for cmd in "count" "select id,comment" "filter name name7" "convert tab"; do
+  serial="$(./csvtool $cmd csvtool_test.csv | cksum)"
+  check "$serial" sh -c "./csvtool -j 4 $cmd csvtool_test.csv | cksum"
+done
+check "400000" ./csvtool -j 4 count csvtool_test.csv
+
+# Test error condition: a row with too few values in a later range
+echo "bad row" >> csvtool_test.csv
+if ./csvtool -j 4 count csvtool_test.csv 2>/dev/null; then
+  echo "FAILED: bad row with several threads"
+  exit 1
+fi
+
+# Test error conditions
+if ./csvtool select nope input.csv 2>/dev/null; then
+  echo "FAILED: missing column"
+  exit 1
+fi
+if ./csvtool frobnicate input.csv 2>/dev/null; then
+  echo "FAILED: unknown command"
+  exit 1
+fi
+
+rm -f csvtool_test.csv
+echo "csvtool_test PASSED"
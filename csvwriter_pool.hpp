@@ -0,0 +1,328 @@
+/* -*- mode: c++ -*- */
+#ifndef CSVWRITER_POOL_HPP
+#define CSVWRITER_POOL_HPP
+/* csvwriter_pool.hpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ *
+ * Write CSV using a pool of threads.  Rows are collected into batches, each
+ * batch is formatted by a worker thread, and a sequencer thread writes the
+ * formatted batches in their original order.  The output is the same as
+ * csvwriter's.
+ */
+
+#include "csvstream.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <cstdint>
+
+
+// csvwriter_pool interface
+class csvwriter_pool {
+public:
+  // Constructor from filename.  Writes the header.  Rows are formatted in
+  // batches of batch_size rows by nthreads threads, with at most
+  // max_in_flight batches buffered at once.  Throws csvstream_exception if
+  // open fails.
+  csvwriter_pool(const std::string &filename,
+                 const std::vector<std::string> &header,
+                 char delimiter=',',
+                 size_t nthreads=std::thread::hardware_concurrency(),
+                 size_t batch_size=1024,
+                 size_t max_in_flight=0)
+    : filename(filename),
+      os(fout),
+      header(header),
+      delimiter(delimiter) {
+
+    // Open file
+    fout.open(filename.c_str(), std::ios::binary);
+    if (!fout.is_open()) {
+      throw csvstream_exception("Error opening file: " + filename);
+    }
+
+    start(nthreads, batch_size, max_in_flight);
+  }
+
+  // Constructor from stream.  Writes the header.
+  csvwriter_pool(std::ostream &os,
+                 const std::vector<std::string> &header,
+                 char delimiter=',',
+                 size_t nthreads=std::thread::hardware_concurrency(),
+                 size_t batch_size=1024,
+                 size_t max_in_flight=0)
+    : filename("[no filename]"),
+      os(os),
+      header(header),
+      delimiter(delimiter) {
+    start(nthreads, batch_size, max_in_flight);
+  }
+
+  // Destructor writes any remaining rows.  Call close() instead to see
+  // errors.
+  ~csvwriter_pool() {
+    try {
+      close();
+    } catch(...) {
+    }
+  }
+
+  // Return false if an error flag on underlying stream was set by a write.
+  // Rows still queued may not have been written yet.
+  explicit operator bool() const {
+    return !stream_failed.load(std::memory_order_acquire);
+  }
+
+  // Return header written by constructor
+  std::vector<std::string> getheader() const {
+    return header;
+  }
+
+  // Stream insertion operator queues one row of values in column order.
+  // Throws csvstream_exception if the number of items in a row does not match
+  // the header, or if a worker failed to format an earlier row.
+  csvwriter_pool & operator<< (const std::vector<std::string>& row) {
+    check_size(row.size());
+    current.push_back(row);
+    return added();
+  }
+
+  // Stream insertion operator queues one row in header order.  Throws
+  // csvstream_exception if a column is missing.
+  csvwriter_pool & operator<< (const std::map<std::string, std::string>& row) {
+    std::vector<std::string> values(header.size());
+    for (size_t i=0; i<header.size(); ++i) {
+      auto it = row.find(header[i]);
+      if (it == row.end()) {
+        throw csvstream_exception("Missing column in row. " + filename +
+                                  ":L" + std::to_string(line_no + 1) + " " +
+                                  "column = " + header[i] + " ");
+      }
+      values[i] = it->second;
+    }
+    current.push_back(std::move(values));
+    return added();
+  }
+
+  // Stream insertion operator queues one row in the row's order.  Throws
+  // csvstream_exception if the number of items in a row does not match the
+  // header.
+  csvwriter_pool & operator<< (const std::vector<std::pair<std::string, std::string> >& row) {
+    check_size(row.size());
+    std::vector<std::string> values(row.size());
+    for (size_t i=0; i<row.size(); ++i) {
+      values[i] = row[i].second;
+    }
+    current.push_back(std::move(values));
+    return added();
+  }
+
+  // Write all queued rows and stop the threads.  Throws csvstream_exception
+  // if any row couldn't be formatted.  The batches before the first one that
+  // failed are written, and none after it.
+  void close() {
+    if (threads.empty()) return;
+    submit();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closing = true;
+    }
+    cv.notify_all();
+    for (auto &t : threads) t.join();
+    threads.clear();
+    if (fout.is_open()) fout.close();
+    if (!os) stream_failed.store(true, std::memory_order_release);
+    if (error) std::rethrow_exception(error);
+  }
+
+private:
+  // A batch of rows, and its formatted output
+  struct batch {
+    size_t seq;
+    std::vector<std::vector<std::string> > rows;
+    std::string output;
+    bool done;
+  };
+
+  // Filename.  Used for error messages.
+  std::string filename;
+
+  // File stream, used when library is called with filename ctor
+  std::ofstream fout;
+
+  // Output stream
+  std::ostream &os;
+
+  // Header column names
+  std::vector<std::string> header;
+
+  // Delimiter between columns
+  char delimiter;
+
+  // Line no in file.  Used for error messages
+  size_t line_no;
+
+  // Rows per batch, and maximum batches queued or formatted but not written
+  size_t batch_size;
+  size_t max_in_flight;
+
+  // Batch being filled by the caller
+  std::vector<std::vector<std::string> > current;
+
+  // Batches in flight, in sequence order.  Workers format the first batch
+  // that isn't claimed, the sequencer writes from the front.
+  std::deque<batch> in_flight;
+  size_t next_seq;
+  size_t next_unclaimed;
+
+  // Worker threads and the sequencer thread
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool closing;
+
+  // Error from the earliest batch that failed, and that batch's sequence
+  // number.  Batches before it are still written.
+  std::exception_ptr error;
+  size_t error_seq;
+
+  // Set when the output stream fails.  Only the sequencer thread writes to
+  // the stream while it runs, so this is read instead of the stream's state.
+  std::atomic<bool> stream_failed;
+
+  // Disable copying because copying streams is bad!
+  csvwriter_pool(const csvwriter_pool &);
+  csvwriter_pool & operator= (const csvwriter_pool &);
+
+  // Write the header and start the threads
+  void start(size_t nthreads, size_t batch_size, size_t max_in_flight) {
+    if (!nthreads) nthreads = 1;
+    this->line_no = 0;
+    this->batch_size = batch_size ? batch_size : 1;
+    this->max_in_flight = max_in_flight ? max_in_flight : 4 * nthreads;
+    next_seq = 0;
+    next_unclaimed = 0;
+    closing = false;
+    error_seq = SIZE_MAX;
+
+    std::string line;
+    csvwriter::append_line(line, header, delimiter);
+    os.write(line.data(), static_cast<std::streamsize>(line.size()));
+    stream_failed.store(!os, std::memory_order_release);
+
+    for (size_t i=0; i<nthreads; ++i) {
+      threads.emplace_back([this]() { format_loop(); });
+    }
+    threads.emplace_back([this]() { write_loop(); });
+  }
+
+  // Throw csvstream_exception if a row size doesn't match the header
+  void check_size(size_t size) const {
+    if (size != header.size()) {
+      auto msg = "Number of items in row does not match header. " +
+        filename + ":L" + std::to_string(line_no + 1) + " " +
+        "header.size() = " + std::to_string(header.size()) + " " +
+        "row.size() = " + std::to_string(size) + " "
+        ;
+      throw csvstream_exception(msg);
+    }
+  }
+
+  // Count a queued row, and submit the batch when it's full.  Rethrows a
+  // worker's error.
+  csvwriter_pool & added() {
+    line_no += 1;
+    if (current.size() >= batch_size) {
+      submit();
+      std::lock_guard<std::mutex> lock(mutex);
+      if (error) std::rethrow_exception(error);
+    }
+    return *this;
+  }
+
+  // Hand the current batch to the workers, waiting while the in-flight
+  // window is full.  After an error, the batch is discarded.
+  void submit() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (error) current.clear();
+    if (current.empty()) return;
+    cv.wait(lock, [this]() { return in_flight.size() < max_in_flight; });
+    batch b;
+    b.seq = next_seq++;
+    b.rows.swap(current);
+    b.done = false;
+    in_flight.push_back(std::move(b));
+    cv.notify_all();
+  }
+
+  // Worker thread: format batches
+  void format_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      cv.wait(lock, [this]() {
+        return closing || next_unclaimed < next_seq;
+      });
+      if (next_unclaimed == next_seq) return;
+
+      // Claim the next batch.  in_flight only grows at the back and shrinks
+      // at the front, and the front batch isn't removed until it's done, so
+      // the reference stays valid.
+      size_t seq = next_unclaimed++;
+      batch &b = in_flight[seq - in_flight.front().seq];
+      lock.unlock();
+      std::string output;
+      std::exception_ptr e;
+      try {
+        for (auto &row : b.rows) {
+          csvwriter::append_line(output, row, delimiter);
+        }
+      } catch(...) {
+        e = std::current_exception();
+      }
+      lock.lock();
+      b.output.swap(output);
+      b.done = true;
+      if (e && seq < error_seq) {
+        error = e;
+        error_seq = seq;
+      }
+      cv.notify_all();
+    }
+  }
+
+  // Sequencer thread: write formatted batches in order
+  void write_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      cv.wait(lock, [this]() {
+        return (!in_flight.empty() && in_flight.front().done) ||
+          (closing && in_flight.empty());
+      });
+      if (in_flight.empty()) return;
+      std::string output;
+      output.swap(in_flight.front().output);
+      bool failed = in_flight.front().seq >= error_seq;
+      lock.unlock();
+      if (!failed) {
+        os.write(output.data(), static_cast<std::streamsize>(output.size()));
+        if (!os) stream_failed.store(true, std::memory_order_release);
+      }
+      lock.lock();
+      in_flight.pop_front();
+      cv.notify_all();
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,179 @@
+/* csvwriter_pool_test.cpp
+ *
+ * Andrew DeOrio <awdeorio@umich.edu>
+ *
+ * An easy-to-use CSV file parser for C++
+ * https://github.com/awdeorio/csvstream
+ */
+
+#include "csvwriter_pool.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+using namespace std;
+
+
+void test_pool_matches_writer();
+void test_pool_roundtrip();
+void test_pool_errors();
+void test_pool_partial_output();
+void test_pool_stream_failure();
+
+
+int main() {
+  test_pool_matches_writer();
+  test_pool_roundtrip();
+  test_pool_errors();
+  test_pool_partial_output();
+  test_pool_stream_failure();
+  cout << "csvwriter_pool_test PASSED\n";
+  return 0;
+}
+
+
+// data for next few unit tests
+const vector<string> header = {"id", "text", "note"};
+
+
+// Generate rows with values that need quoting or contain escapes
+vector<vector<string>> generate_rows(size_t nrows) {
+  vector<vector<string>> rows;
+  for (size_t i=0; i<nrows; ++i) {
+    rows.push_back({to_string(i),
+                    i % 3 ? "plain" : "with, comma\nand newline",
+                    i % 5 ? "" : "\\\"escaped\\\""});
+  }
+  return rows;
+}
+
+
+void test_pool_matches_writer() {
+  // Test that the output is the same as csvwriter's for each row type and
+  // several thread counts, batch sizes and window sizes
+
+  vector<vector<string>> rows = generate_rows(1000);
+  ostringstream output_correct;
+  {
+    csvwriter csvout(output_correct, header, '|');
+    for (auto &row : rows) csvout << row;
+  }
+
+  for (size_t nthreads : {1u, 2u, 8u}) {
+    for (size_t batch_size : {1u, 7u, 4096u}) {
+      ostringstream output_observed;
+      csvwriter_pool csvout(output_observed, header, '|',
+                            nthreads, batch_size, 2);
+      for (size_t i=0; i<rows.size(); ++i) {
+        if (i % 3 == 0) {
+          csvout << rows[i];
+        } else if (i % 3 == 1) {
+          map<string, string> row;
+          for (size_t j=0; j<header.size(); ++j) row[header[j]] = rows[i][j];
+          csvout << row;
+        } else {
+          vector<pair<string, string>> row;
+          for (size_t j=0; j<header.size(); ++j) {
+            row.push_back({header[j], rows[i][j]});
+          }
+          csvout << row;
+        }
+      }
+      csvout.close();
+      assert(output_observed.str() == output_correct.str());
+    }
+  }
+}
+
+
+void test_pool_roundtrip() {
+  // Test that the output reads back unchanged with the same delimiter
+
+  vector<vector<string>> rows = generate_rows(500);
+  stringstream ss;
+  {
+    csvwriter_pool csvout(ss, header, '\t', 4, 16);
+    for (auto &row : rows) csvout << row;
+  }
+
+  csvstream csvin(ss, '\t');
+  assert(csvin.getheader() == header);
+  vector<vector<string>> output_observed;
+  vector<string> row;
+  while (csvin >> row) output_observed.push_back(row);
+  assert(output_observed == rows);
+}
+
+
+void test_pool_errors() {
+  // Test error conditions: a row of the wrong size is reported immediately,
+  // and a value that can't be written is reported by close()
+
+  ostringstream oss;
+  csvwriter_pool csvout(oss, header, ',', 2, 4);
+  try {
+    csvout << vector<string>({"1", "2"});
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()).find("row.size() = 2") != string::npos);
+  }
+
+  csvout << vector<string>({"1", "say \"hi\"", ""});
+  try {
+    csvout.close();
+    assert(0);
+  } catch(const csvstream_exception &e) {
+    assert(string(e.what()).find("quote") != string::npos);
+  }
+}
+
+
+void test_pool_partial_output() {
+  // Test that after a value can't be written, every batch before the one
+  // that failed is written, in order, however the workers finish
+
+  vector<vector<string>> rows = generate_rows(200);
+  rows[100][1] = "say \"hi\"";
+  ostringstream output_correct;
+  {
+    csvwriter csvout(output_correct, header);
+    for (size_t i=0; i<100; ++i) csvout << rows[i];
+  }
+
+  for (size_t trial=0; trial<20; ++trial) {
+    ostringstream output_observed;
+    string what;
+    {
+      csvwriter_pool csvout(output_observed, header, ',', 4, 10, 64);
+      try {
+        for (auto &row : rows) csvout << row;
+        csvout.close();
+      } catch(const csvstream_exception &e) {
+        what = e.what();
+      }
+    }
+    assert(what.find("quote") != string::npos);
+    assert(output_observed.str() == output_correct.str());
+  }
+}
+
+
+void test_pool_stream_failure() {
+  // Test error condition: writes to a stream without a buffer fail.  The
+  // failure is reported without reading the stream's state while the
+  // sequencer thread writes to it.
+
+  ostream os(nullptr);
+  csvwriter_pool csvout(os, header, ',', 2, 4);
+  assert(!csvout);
+  for (auto &row : generate_rows(100)) csvout << row;
+  csvout.close();
+  assert(!csvout);
+
+  ostringstream oss;
+  csvwriter_pool csvout_ok(oss, header, ',', 2, 4);
+  for (auto &row : generate_rows(100)) csvout_ok << row;
+  csvout_ok.close();
+  assert(csvout_ok);
+}